@@ -0,0 +1,388 @@
+// Micro-benchmarks for the raster and history hot paths. Each run prints
+// one JSON object per line on stdout, for example
+//
+//   {"bench":"draw_thick_line","canvas":"1920x1080","size":16,"ops":81920,
+//    "ns_per_op":412.3,"pixels_per_s":1.2e+09,"allocs_per_op":0.00}
+//
+// "pixels_per_s" is null for benchmarks that do not rasterize. Pixel counts
+// are the geometric area of what was drawn, not pixels actually changed.
+// Allocations count malloc/calloc/realloc calls made by MobPaint code; the
+// bench is linked with --wrap for them.
+//
+// usage: mobpaint_bench [--time MS] [FILTER]
+//   --time MS  Minimum time spent measuring each run (default 200)
+//   FILTER     Only run benchmarks whose name contains FILTER
+
+#define SDL_MAIN_HANDLED
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "canvas/canvas.h"
+#include "context/history.h"
+#include "context/keyframes.h"
+#include "context/paint_context.h"
+#include "tools/tools.h"
+
+#define SEGMENT_COUNT 64
+#define PI 3.14159265358979323846
+
+static SDL_atomic_t allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    SDL_AtomicAdd(&allocations, 1);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    SDL_AtomicAdd(&allocations, 1);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    SDL_AtomicAdd(&allocations, 1);
+    return __real_realloc(pointer, size);
+}
+
+static double min_time_ms = 200.0;
+static const char *filter = NULL;
+
+// Performs `batch` operations; `iteration` counts calls from 0
+typedef void (*BenchOp)(void *state, long iteration);
+
+typedef struct Bench {
+    const char *name;       // Benchmark name
+    char params[128];       // Sweep parameters as JSON members
+    BenchOp op;             // Operation to time
+    void *state;            // Passed to op
+    int batch;              // Operations per call of op
+    double pixels_per_op;   // Area drawn per operation, 0 if not a raster op
+} Bench;
+
+static bool wanted(const char *name) {
+    return !filter || strstr(name, filter) != NULL;
+}
+
+static double seconds_since(Uint64 start) {
+    return (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+// Calls the operation in growing rounds until the minimum time is spent,
+// after one warm-up call, and prints the result line.
+static void run_bench(const Bench *bench) {
+    long calls = 0;
+    bench->op(bench->state, calls++);
+
+    int before = SDL_AtomicGet(&allocations);
+    Uint64 start = SDL_GetPerformanceCounter();
+    long measured = 0;
+    double elapsed = 0;
+    for (long round = 1; elapsed * 1000.0 < min_time_ms; round *= 2) {
+        for (long i = 0; i < round; i++)
+            bench->op(bench->state, calls++);
+        measured += round;
+        elapsed = seconds_since(start);
+    }
+    int allocated = SDL_AtomicGet(&allocations) - before;
+
+    double ops = (double)measured * bench->batch;
+    printf("{\"bench\":\"%s\",%s,\"ops\":%.0f,\"ns_per_op\":%.1f,", bench->name, bench->params, ops,
+           elapsed * 1e9 / ops);
+    if (bench->pixels_per_op > 0)
+        printf("\"pixels_per_s\":%.3g,", bench->pixels_per_op * ops / elapsed);
+    else
+        printf("\"pixels_per_s\":null,");
+    printf("\"allocs_per_op\":%.2f}\n", allocated / ops);
+    fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+// Raster
+
+static const SDL_Point canvas_sizes[] = {{512, 512}, {1920, 1080}, {4096, 4096}};
+static const int brush_sizes[] = {1, 4, 16, 64};
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+typedef struct ShapeState {
+    Canvas *canvas;
+    SDL_Point from[SEGMENT_COUNT];
+    SDL_Point to[SEGMENT_COUNT];
+    int size;
+    Uint32 color;
+} ShapeState;
+
+// Segments of up to `reach` pixels placed at random on the canvas
+static void init_shapes(ShapeState *state, int width, int height, int size, int reach) {
+    state->canvas = create_canvas(width, height);
+    canvas_clear(state->canvas, 0xFFFFFFFF);
+    state->size = size;
+    state->color = 0xFF204080;
+    for (int i = 0; i < SEGMENT_COUNT; i++) {
+        state->from[i] = (SDL_Point){rand() % width, rand() % height};
+        state->to[i] = (SDL_Point){state->from[i].x + rand() % (2 * reach + 1) - reach,
+                                   state->from[i].y + rand() % (2 * reach + 1) - reach};
+    }
+}
+
+static double segment_length(const ShapeState *state, int i) {
+    double dx = state->to[i].x - state->from[i].x;
+    double dy = state->to[i].y - state->from[i].y;
+    return sqrt(dx * dx + dy * dy);
+}
+
+static void line_op(void *data, long iteration) {
+    ShapeState *state = data;
+    int i = (int)(iteration % SEGMENT_COUNT);
+    draw_thick_line(state->canvas, state->from[i].x, state->from[i].y, state->to[i].x, state->to[i].y,
+                    state->size, state->color);
+}
+
+static void circle_op(void *data, long iteration) {
+    ShapeState *state = data;
+    int i = (int)(iteration % SEGMENT_COUNT);
+    draw_thick_circle(state->canvas, state->from[i].x, state->from[i].y, state->to[i].x, state->to[i].y,
+                      state->size, state->color);
+}
+
+static void bench_shapes(const char *name, BenchOp op, bool circle) {
+    if (!wanted(name))
+        return;
+
+    for (int c = 0; c < COUNT(canvas_sizes); c++) {
+        for (int s = 0; s < COUNT(brush_sizes); s++) {
+            ShapeState state;
+            init_shapes(&state, canvas_sizes[c].x, canvas_sizes[c].y, brush_sizes[s], 256);
+
+            // Capsule area for lines; annulus area for circles drawn across
+            // the segment as their diameter
+            double area = 0;
+            for (int i = 0; i < SEGMENT_COUNT; i++) {
+                double length = segment_length(&state, i);
+                double r = brush_sizes[s] / 2.0;
+                area += circle ? PI * length * brush_sizes[s] : length * brush_sizes[s] + PI * r * r;
+            }
+
+            Bench bench = {name, "", op, &state, 1, area / SEGMENT_COUNT};
+            snprintf(bench.params, sizeof(bench.params), "\"canvas\":\"%dx%d\",\"size\":%d",
+                     canvas_sizes[c].x, canvas_sizes[c].y, brush_sizes[s]);
+            run_bench(&bench);
+            free_canvas(state.canvas);
+        }
+    }
+}
+
+typedef struct FillState {
+    Canvas *canvas;
+    int x, y;
+    SDL_Color colors[2];
+} FillState;
+
+static void fill_op(void *data, long iteration) {
+    FillState *state = data;
+    flood_fill(state->canvas, state->x, state->y, state->colors[iteration % 2], NULL);
+}
+
+// Fills the canvas from its center, alternating two colors so every call
+// refills the same region. With `walls`, random strokes split the canvas
+// into irregular regions, which is what makes the span stack work.
+static void bench_flood_fill(void) {
+    if (!wanted("flood_fill"))
+        return;
+
+    for (int c = 0; c < COUNT(canvas_sizes); c++) {
+        for (int walls = 0; walls <= 1; walls++) {
+            int width = canvas_sizes[c].x, height = canvas_sizes[c].y;
+            FillState state = {create_canvas(width, height), width / 2, height / 2,
+                               {{200, 40, 40, 255}, {40, 200, 40, 255}}};
+            canvas_clear(state.canvas, 0xFFFFFFFF);
+            for (int i = 0; walls && i < 64; i++)
+                draw_thick_line(state.canvas, rand() % width, rand() % height, rand() % width, rand() % height,
+                                3, 0xFF000000);
+            while (state.x < width - 1 && canvas_get_pixel(state.canvas, state.x, state.y) != 0xFFFFFFFF)
+                state.x++;
+
+            Span *spans = NULL;
+            int count = flood_fill(state.canvas, state.x, state.y, state.colors[1], &spans);
+            double area = 0;
+            for (int i = 0; i < count; i++)
+                area += spans[i].x2 - spans[i].x1 + 1;
+            free(spans);
+
+            Bench bench = {"flood_fill", "", fill_op, &state, 1, area};
+            snprintf(bench.params, sizeof(bench.params), "\"canvas\":\"%dx%d\",\"walls\":%s",
+                     width, height, walls ? "true" : "false");
+            run_bench(&bench);
+            free_canvas(state.canvas);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// History
+
+typedef struct HistoryState {
+    History history;
+    HistoryEntry entry;
+    int points;
+} HistoryState;
+
+static void push_pop_op(void *data, long iteration) {
+    (void)iteration;
+    HistoryState *state = data;
+    push_history(&state->history, &state->entry);
+    pop_history(&state->history, &state->entry);
+}
+
+// One push and one pop on top of a history of `depth` entries; entries
+// move in and out without copying their contents.
+static void bench_push_pop(void) {
+    if (!wanted("push_pop_history"))
+        return;
+
+    static const int depths[] = {0, 1000, 100000};
+    for (int d = 0; d < COUNT(depths); d++) {
+        HistoryState state;
+        init_history(&state.history);
+        state.entry = (HistoryEntry){.tool = {.type = TOOL_BRUSH, .size = 4}};
+        for (int i = 0; i < depths[d]; i++) {
+            HistoryEntry filler = state.entry;
+            push_history(&state.history, &filler);
+        }
+
+        Bench bench = {"push_pop_history", "", push_pop_op, &state, 1, 0};
+        snprintf(bench.params, sizeof(bench.params), "\"depth\":%d", depths[d]);
+        run_bench(&bench);
+        free_history(&state.history);
+    }
+}
+
+static void add_point_op(void *data, long iteration) {
+    (void)iteration;
+    HistoryState *state = data;
+    HistoryEntry entry = {0};
+    for (int i = 0; i < state->points; i++)
+        add_point_to_entry(&entry, i, i / 2);
+    free_history_entry(&entry);
+}
+
+// Builds a stroke point by point; reported per point, so the growth of the
+// point array is amortized over the stroke length.
+static void bench_add_point(void) {
+    if (!wanted("add_point_to_entry"))
+        return;
+
+    static const int lengths[] = {16, 256, 4096};
+    for (int l = 0; l < COUNT(lengths); l++) {
+        HistoryState state = {.points = lengths[l]};
+        Bench bench = {"add_point_to_entry", "", add_point_op, &state, lengths[l], 0};
+        snprintf(bench.params, sizeof(bench.params), "\"stroke_points\":%d", lengths[l]);
+        run_bench(&bench);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Replay
+
+static void redraw_op(void *data, long iteration) {
+    (void)iteration;
+    redraw_canvas(data);
+}
+
+// Paints `strokes` random brush strokes, then drops every keyframe but the
+// blank one so redraw_canvas() replays the whole history.
+static double paint_history(PaintContext *ctx, int strokes, int size) {
+    double area = 0;
+    for (int s = 0; s < strokes; s++) {
+        ctx->current_tool.size = size;
+        ctx->current_tool.color = (SDL_Color){(Uint8)(s * 7), (Uint8)(s * 13), 128, s % 4 ? 255 : 128};
+        ctx->mouse_x = rand() % ctx->canvas->width;
+        ctx->mouse_y = rand() % ctx->canvas->height;
+        start_stroke(ctx);
+        use_tool(ctx, -1, -1);
+
+        Point points[32];
+        Point last = {ctx->mouse_x, ctx->mouse_y};
+        for (int i = 0; i < 32; i++) {
+            points[i] = (Point){last.x + rand() % 41 - 20, last.y + rand() % 41 - 20};
+            area += hypot(points[i].x - last.x, points[i].y - last.y) * size;
+            last = points[i];
+        }
+        extend_stroke(ctx, points, 32);
+        end_stroke(ctx);
+    }
+
+    Canvas *blank = create_canvas(ctx->canvas->width, ctx->canvas->height);
+    canvas_clear(blank, ctx->background);
+    size_t budget = ctx->keyframes.memory_budget;
+    free_keyframes(&ctx->keyframes);
+    init_keyframes(&ctx->keyframes, blank, budget);
+    free_canvas(blank);
+    return area;
+}
+
+static void bench_redraw(void) {
+    if (!wanted("redraw_canvas"))
+        return;
+
+    static const int stroke_counts[] = {100, 1000};
+    static const int sizes[] = {4, 32};
+    static const int threads[] = {1, 0};
+    for (int c = 0; c < 2; c++) {
+        for (int n = 0; n < COUNT(stroke_counts); n++) {
+            for (int s = 0; s < COUNT(sizes); s++) {
+                Config config = {
+                    .window_width = canvas_sizes[c].x,
+                    .window_height = canvas_sizes[c].y,
+                    .default_background_color = {255, 255, 255, 255},
+                    .history_memory_budget_mb = 1024,
+                };
+                Tool tool;
+                init_tool(&tool, NULL);
+                PaintContext ctx;
+                init_paint_context(NULL, &ctx, &config, tool);
+                double area = paint_history(&ctx, stroke_counts[n], sizes[s]);
+
+                for (int t = 0; t < COUNT(threads); t++) {
+                    ctx.replay_threads = threads[t];
+                    Bench bench = {"redraw_canvas", "", redraw_op, &ctx, 1, area};
+                    snprintf(bench.params, sizeof(bench.params),
+                             "\"canvas\":\"%dx%d\",\"strokes\":%d,\"size\":%d,\"threads\":%d",
+                             canvas_sizes[c].x, canvas_sizes[c].y, stroke_counts[n], sizes[s],
+                             threads[t] ? threads[t] : SDL_GetCPUCount());
+                    run_bench(&bench);
+                }
+                free_paint_context(&ctx);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+            min_time_ms = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--time MS] [FILTER]\n", argv[0]);
+            return 2;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    // Fixed seed so every run measures the same shapes
+    srand(1);
+    bench_shapes("draw_thick_line", line_op, false);
+    bench_shapes("draw_thick_circle", circle_op, true);
+    bench_flood_fill();
+    bench_push_pop();
+    bench_add_point();
+    bench_redraw();
+    return 0;
+}
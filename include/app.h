@@ -1,15 +1,27 @@
 #ifndef APP_H
 #define APP_H
 
+#include <SDL2/SDL.h>
 #include "context/config.h"
 
+// Input recording and replay (input_record.h) requested on the command line
+typedef struct {
+    const char *record_path;    // Record the session's input here, or NULL
+    const char *replay_path;    // Replay this recording instead of taking input, or NULL
+    bool replay_realtime;       // Replay at the recorded pace rather than as fast as possible
+} InputOptions;
+
 /**
  * Starts the main application window and event loop.
  *
  * @param target_file_path Path to the target file (image or canvas) to load.
  * @param config          Pointer to the Config structure with application settings.
+ * @param start           SDL_GetPerformanceCounter() at process start, for startup timing.
+ * @param input           Input recording or replay to run, if any. A replay opens the
+ *                        target read-only, exits when the recording ends and fails if
+ *                        the final canvas differs from the recorded one.
  * @return                0 on success, non-zero on failure.
  */
-int run_app(const char *target_file_path, Config *config);
+int run_app(const char *target_file_path, Config *config, Uint64 start, const InputOptions *input);
 
 #endif // APP_H
@@ -0,0 +1,41 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+// The UI assets are compiled into the binary: tools/pack_assets.c decodes the
+// files under assets/ at build time and writes them out as C arrays, so
+// startup neither touches the disk nor decodes PNGs.
+
+// A decoded image, ARGB8888 with straight alpha, rows packed
+typedef struct AssetImage {
+    int width;              // Width in pixels
+    int height;             // Height in pixels
+    const Uint32 *pixels;   // width * height pixels, top row first
+} AssetImage;
+
+// A file embedded as-is
+typedef struct AssetData {
+    const Uint8 *data;      // File contents
+    size_t size;            // Length in bytes
+} AssetData;
+
+// Tool icons, in ToolType order
+extern const AssetImage asset_brush;
+extern const AssetImage asset_eraser;
+extern const AssetImage asset_line;
+extern const AssetImage asset_circle;
+extern const AssetImage asset_fill;
+extern const AssetImage asset_text;
+
+// Top bar icons
+extern const AssetImage asset_undo;
+extern const AssetImage asset_redo;
+extern const AssetImage asset_plus;
+extern const AssetImage asset_minus;
+
+// UI and text tool font (TrueType)
+extern const AssetData asset_open_sans;
+
+#endif // ASSET_PACK_H
@@ -3,19 +3,45 @@
 
 #include <SDL2/SDL.h>
 
+// UI icons. The tool icons come first, in ToolType order.
+typedef enum {
+    ICON_BRUSH,
+    ICON_ERASER,
+    ICON_LINE,
+    ICON_CIRCLE,
+    ICON_FILL,
+    ICON_TEXT,
+    ICON_UNDO,
+    ICON_REDO,
+    ICON_PLUS,
+    ICON_MINUS,
+    ICON_COUNT
+} AssetIcon;
+
+// Textures for the embedded icons (see asset_pack.h), created on first use
 typedef struct {
-    SDL_Texture *tool_icons[16];  // Tool icons
-    SDL_Texture *undo;
-    SDL_Texture *redo;
-    SDL_Texture *plus;
-    SDL_Texture *minus;
+    SDL_Renderer *renderer;             // Renderer the textures belong to
+    SDL_Texture *icons[ICON_COUNT];     // Uploaded icons, NULL until first drawn
 } Assets;
 
 /**
- * Loads all required UI assets.
+ * Prepares the UI assets. Nothing is decoded or uploaded here; each icon
+ * becomes a texture the first time it is drawn.
+ *
+ * @param renderer Renderer the icons are drawn with.
+ * @return         Assets, or NULL on allocation failure.
  */
 Assets *load_assets(SDL_Renderer *renderer);
 
+/**
+ * Returns an icon's texture, uploading it on first use.
+ *
+ * @param assets Assets from load_assets().
+ * @param icon   Icon to get.
+ * @return       Texture, or NULL if it could not be created.
+ */
+SDL_Texture *get_icon(Assets *assets, AssetIcon icon);
+
 /**
  * Frees all loaded assets.
  */
@@ -0,0 +1,266 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include "canvas/dirty_region.h"
+#include "canvas/tile.h"
+
+// Pixel layout of every canvas buffer: 0xAARRGGBB in native byte order, with
+// the color channels premultiplied by alpha (see canvas/pixel_ops.h)
+#define CANVAS_PIXEL_FORMAT SDL_PIXELFORMAT_ARGB8888
+
+// Horizontal run of pixels [x1, x2] (inclusive) on row y
+typedef struct Span {
+    int x1;
+    int x2;
+    int y;
+} Span;
+
+// CPU-side raster owned by the application. Tools write pixels straight
+// into it and SDL is only used to present the result. Every write records
+// the touched area in `dirty` so only damaged pixels get presented.
+//
+// Pixels live in reference-counted CANVAS_TILE_SIZE tiles. A tile shared
+// with the undo history is copied on its first write, and while a stroke
+// is being recorded the pre-stroke tile is kept in `recording`. A stroke
+// drawn in pieces can also keep a coverage bitmap, so pixels where the
+// pieces overlap are blended once, as when the whole stroke is replayed.
+typedef struct Canvas {
+    int width;              // Width in pixels
+    int height;             // Height in pixels
+    int tiles_x;            // Number of tile columns
+    int tiles_y;            // Number of tile rows
+    CanvasTile **tiles;     // tiles_x * tiles_y tiles, row-major
+    DirtyRegion dirty;      // Area written since the last present
+
+    TileDelta *recording;   // Delta collecting the current stroke, or NULL
+    Uint32 *record_stamp;   // Per tile: generation it was last recorded in
+    Uint32 record_generation; // Generation of the active recording
+    Uint64 *coverage;       // One bit per pixel written by the current stroke, or NULL
+    int coverage_stride;    // Words per bitmap row
+    bool covering;          // Translucent spans skip pixels the stroke already covered
+    int covered_top;        // Bitmap rows that may have bits set
+    int covered_bottom;
+    SDL_Rect clip;          // Writes outside it are dropped; all of the canvas except during banded replay
+} Canvas;
+
+/**
+ * Allocates a canvas of the given size, cleared to transparent black.
+ *
+ * @param width  Canvas width in pixels.
+ * @param height Canvas height in pixels.
+ * @return       Newly allocated canvas, or NULL on failure.
+ */
+Canvas *create_canvas(int width, int height);
+
+/**
+ * Frees a canvas and releases its tiles.
+ *
+ * @param canvas Canvas to free (may be NULL).
+ */
+void free_canvas(Canvas *canvas);
+
+/**
+ * Converts an SDL_Color into the canvas pixel format.
+ *
+ * @param color Color to convert.
+ * @return      Packed, premultiplied ARGB8888 pixel value.
+ */
+Uint32 canvas_map_color(SDL_Color color);
+
+/**
+ * Converts a canvas pixel value back into an SDL_Color.
+ *
+ * @param pixel Packed, premultiplied ARGB8888 pixel value.
+ * @return      Unpacked color.
+ */
+SDL_Color canvas_unmap_color(Uint32 pixel);
+
+/**
+ * Fills the whole canvas with a single pixel value. All tiles end up
+ * sharing one solid tile until they are drawn on.
+ *
+ * @param canvas Target canvas.
+ * @param color  Pixel value to write.
+ */
+void canvas_clear(Canvas *canvas, Uint32 color);
+
+/**
+ * Makes `dst` show the same pixels as `src` by sharing its tiles.
+ *
+ * @param dst Destination canvas.
+ * @param src Source canvas.
+ * @return    true on success, false if the sizes differ.
+ */
+bool canvas_copy(Canvas *dst, const Canvas *src);
+
+/**
+ * Reads a single pixel. Coordinates outside the canvas return 0.
+ *
+ * @param canvas Source canvas.
+ * @param x      X coordinate.
+ * @param y      Y coordinate.
+ * @return       Pixel value at (x, y).
+ */
+Uint32 canvas_get_pixel(const Canvas *canvas, int x, int y);
+
+/**
+ * Writes a single pixel. Coordinates outside the clip rectangle are ignored.
+ *
+ * @param canvas Target canvas.
+ * @param x      X coordinate.
+ * @param y      Y coordinate.
+ * @param color  Pixel value to write.
+ */
+void canvas_set_pixel(Canvas *canvas, int x, int y, Uint32 color);
+
+/**
+ * Fills the horizontal span [x1, x2] on row y, clipped to the clip rectangle.
+ * Opaque colors overwrite; translucent ones are composited source-over,
+ * except over pixels the current stroke already covered (see
+ * canvas_begin_coverage()).
+ *
+ * @param canvas Target canvas.
+ * @param x1     First column of the span (inclusive).
+ * @param x2     Last column of the span (inclusive).
+ * @param y      Row of the span.
+ * @param color  Pixel value to write.
+ */
+void canvas_fill_span(Canvas *canvas, int x1, int x2, int y, Uint32 color);
+
+/**
+ * Fills a rectangle, clipped to the clip rectangle. Opaque colors overwrite;
+ * translucent ones are composited source-over.
+ *
+ * @param canvas Target canvas.
+ * @param rect   Rectangle to fill.
+ * @param color  Pixel value to write.
+ */
+void canvas_fill_rect(Canvas *canvas, const SDL_Rect *rect, Uint32 color);
+
+/**
+ * Alpha-blends an ARGB8888 surface onto the canvas (source-over).
+ * Used to composite rendered text.
+ *
+ * @param canvas  Target canvas.
+ * @param surface Source surface with straight (non-premultiplied) alpha.
+ * @param x       Destination X of the surface's top-left corner.
+ * @param y       Destination Y of the surface's top-left corner.
+ */
+void canvas_blend_surface(Canvas *canvas, SDL_Surface *surface, int x, int y);
+
+/**
+ * Composites a color through an 8-bit coverage mask (source-over), e.g. a
+ * glyph from the font atlas.
+ *
+ * @param canvas Target canvas.
+ * @param mask   Top-left coverage value of the mask.
+ * @param pitch  Row stride of `mask` in bytes.
+ * @param rect   Destination of the mask on the canvas (clipped to the clip rectangle).
+ * @param color  Premultiplied pixel value to composite.
+ */
+void canvas_blend_mask(Canvas *canvas, const Uint8 *mask, int pitch, const SDL_Rect *rect, Uint32 color);
+
+/**
+ * Copies a rectangle of the canvas into a linear pixel buffer.
+ *
+ * @param canvas Source canvas.
+ * @param rect   Area to read, must lie inside the canvas.
+ * @param dst    Destination buffer.
+ * @param pitch  Row stride of `dst` in pixels.
+ */
+void canvas_read_pixels(const Canvas *canvas, const SDL_Rect *rect, Uint32 *dst, int pitch);
+
+/**
+ * Hashes the canvas pixels (FNV-1a, row by row). Equal canvases of the same
+ * size give equal checksums; used to compare the results of input replays.
+ *
+ * @param canvas Canvas to hash.
+ * @return       32-bit checksum.
+ */
+Uint32 canvas_checksum(const Canvas *canvas);
+
+/**
+ * Copies a linear pixel buffer into a rectangle of the canvas.
+ *
+ * @param canvas Target canvas.
+ * @param rect   Area to write, must lie inside the canvas.
+ * @param src    Source buffer.
+ * @param pitch  Row stride of `src` in pixels.
+ */
+void canvas_write_pixels(Canvas *canvas, const SDL_Rect *rect, const Uint32 *src, int pitch);
+
+/**
+ * Marks an area of the canvas as damaged without writing to it.
+ *
+ * @param canvas Canvas to invalidate.
+ * @param rect   Area to mark (clipped to the canvas), or NULL for all of it.
+ */
+void canvas_invalidate(Canvas *canvas, const SDL_Rect *rect);
+
+/**
+ * Copies a rectangle of the canvas into a surface at the same position,
+ * converting to the surface's pixel format. Used to present damaged areas.
+ *
+ * @param canvas  Source canvas.
+ * @param rect    Area to copy (clipped to both canvas and surface).
+ * @param surface Destination surface, typically the window surface.
+ */
+void canvas_copy_to_surface(const Canvas *canvas, const SDL_Rect *rect, SDL_Surface *surface);
+
+/**
+ * Starts recording which tiles get modified into `delta`. Every tile is
+ * captured once, before its first write.
+ *
+ * @param canvas Canvas to record.
+ * @param delta  Empty delta that receives the pre-write tiles.
+ */
+void canvas_begin_recording(Canvas *canvas, TileDelta *delta);
+
+/**
+ * Stops recording and stores the resulting tiles as the delta's `after` state.
+ *
+ * @param canvas Canvas being recorded.
+ */
+void canvas_end_recording(Canvas *canvas);
+
+/**
+ * Starts tracking the pixels a stroke covers. Until canvas_end_coverage(),
+ * canvas_fill_span() blends each pixel at most once, so a stroke drawn in
+ * overlapping pieces looks like the same stroke drawn in one go.
+ *
+ * @param canvas Canvas the stroke is drawn on.
+ * @return       false if the coverage bitmap could not be allocated; spans
+ *               then blend as usual.
+ */
+bool canvas_begin_coverage(Canvas *canvas);
+
+/**
+ * Stops tracking stroke coverage and forgets the covered pixels.
+ *
+ * @param canvas Canvas the stroke was drawn on.
+ */
+void canvas_end_coverage(Canvas *canvas);
+
+/**
+ * Swaps the tiles of a recorded delta into the canvas. Costs one pointer
+ * swap per touched tile, independent of history length.
+ *
+ * @param canvas Canvas to modify.
+ * @param delta  Delta produced by a recording on this canvas.
+ * @param undo   true to restore the `before` tiles, false for the `after` tiles.
+ */
+void canvas_apply_delta(Canvas *canvas, const TileDelta *delta, bool undo);
+
+/**
+ * Puts a tile into the canvas in place of the current one, e.g. when loading
+ * a saved raster. The canvas takes its own reference to the tile.
+ *
+ * @param canvas Canvas to modify.
+ * @param index  Tile index (row-major).
+ * @param tile   Tile to use.
+ */
+void canvas_replace_tile(Canvas *canvas, int index, CanvasTile *tile);
+
+#endif // CANVAS_H
@@ -0,0 +1,61 @@
+#ifndef DIRTY_REGION_H
+#define DIRTY_REGION_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+// Maximum number of disjoint rectangles tracked before they get merged
+#define DIRTY_REGION_MAX_RECTS 16
+
+// Extra area (in pixels) two rectangles may waste when merged into one.
+// Keeps neighbouring dabs of a stroke from fragmenting the region.
+#define DIRTY_REGION_MERGE_SLACK (32 * 32)
+
+// Set of damaged rectangles that need to be recomposited and presented
+typedef struct DirtyRegion {
+    SDL_Rect rects[DIRTY_REGION_MAX_RECTS]; // Damaged areas, may overlap
+    int count;                              // Number of rectangles in use
+} DirtyRegion;
+
+/**
+ * Empties the region.
+ *
+ * @param region Region to clear.
+ */
+void dirty_region_clear(DirtyRegion *region);
+
+/**
+ * Checks whether the region contains any damage.
+ *
+ * @param region Region to inspect.
+ * @return true if nothing is damaged, false otherwise.
+ */
+bool dirty_region_is_empty(const DirtyRegion *region);
+
+/**
+ * Adds a damaged rectangle. Rectangles that overlap or sit close to an
+ * existing one are merged; once the region is full the pair with the
+ * smallest growth is merged instead.
+ *
+ * @param region Region to extend.
+ * @param rect   Damaged rectangle (empty rectangles are ignored).
+ */
+void dirty_region_add(DirtyRegion *region, const SDL_Rect *rect);
+
+/**
+ * Adds every rectangle of another region.
+ *
+ * @param region Region to extend.
+ * @param other  Region whose rectangles are added.
+ */
+void dirty_region_merge(DirtyRegion *region, const DirtyRegion *other);
+
+/**
+ * Computes the bounding box of the whole region.
+ *
+ * @param region Region to inspect.
+ * @param bounds Output bounding rectangle (zero-sized if empty).
+ */
+void dirty_region_bounds(const DirtyRegion *region, SDL_Rect *bounds);
+
+#endif // DIRTY_REGION_H
@@ -0,0 +1,90 @@
+#ifndef PIXEL_OPS_H
+#define PIXEL_OPS_H
+
+#include <SDL2/SDL.h>
+
+// Span kernels over premultiplied ARGB8888 pixels. Each operation has an
+// AVX2, SSE2 and scalar implementation; the fastest one the CPU supports is
+// picked on first use. All variants produce bit-identical results.
+
+/**
+ * Converts a straight-alpha ARGB8888 pixel to premultiplied alpha.
+ *
+ * @param pixel Straight-alpha pixel.
+ * @return      Premultiplied pixel.
+ */
+Uint32 premultiply_pixel(Uint32 pixel);
+
+/**
+ * Converts a premultiplied ARGB8888 pixel back to straight alpha.
+ *
+ * @param pixel Premultiplied pixel.
+ * @return      Straight-alpha pixel.
+ */
+Uint32 unpremultiply_pixel(Uint32 pixel);
+
+/**
+ * Premultiplies a run of straight-alpha pixels.
+ *
+ * @param dst   Destination pixels (may equal `src`).
+ * @param src   Straight-alpha source pixels.
+ * @param count Number of pixels.
+ */
+void pixels_premultiply(Uint32 *dst, const Uint32 *src, int count);
+
+/**
+ * Sets a run of pixels to one value.
+ *
+ * @param dst   Destination pixels.
+ * @param count Number of pixels.
+ * @param color Premultiplied pixel value.
+ */
+void pixels_fill(Uint32 *dst, int count, Uint32 color);
+
+/**
+ * Composites one premultiplied color source-over onto a run of pixels.
+ *
+ * @param dst   Destination pixels.
+ * @param count Number of pixels.
+ * @param color Premultiplied source color.
+ */
+void pixels_blend_color(Uint32 *dst, int count, Uint32 color);
+
+/**
+ * Composites premultiplied source pixels source-over onto a run of pixels.
+ *
+ * @param dst   Destination pixels.
+ * @param src   Premultiplied source pixels.
+ * @param count Number of pixels.
+ */
+void pixels_blend(Uint32 *dst, const Uint32 *src, int count);
+
+/**
+ * Composites one premultiplied color source-over onto a run of pixels,
+ * scaled by a per-pixel 8-bit coverage mask (e.g. a glyph bitmap).
+ *
+ * @param dst   Destination pixels.
+ * @param mask  Coverage values, 255 for full coverage.
+ * @param count Number of pixels.
+ * @param color Premultiplied source color.
+ */
+void pixels_blend_mask(Uint32 *dst, const Uint8 *mask, int count, Uint32 color);
+
+/**
+ * Copies a run of pixels. The C library's memcpy already picks a vector
+ * implementation at runtime, so this does not dispatch on its own.
+ *
+ * @param dst   Destination pixels.
+ * @param src   Source pixels (must not overlap `dst`).
+ * @param count Number of pixels.
+ */
+void pixels_copy(Uint32 *dst, const Uint32 *src, int count);
+
+/**
+ * Names the kernel set selected for this CPU.
+ *
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char *pixel_ops_backend(void);
+
+#endif // PIXEL_OPS_H
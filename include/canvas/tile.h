@@ -0,0 +1,110 @@
+#ifndef TILE_H
+#define TILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+// Edge length of a canvas tile in pixels
+#define CANVAS_TILE_SIZE 64
+
+// Fixed-size, reference-counted block of canvas pixels. Tiles are shared
+// between the live canvas and undo history and copied only when written
+// while shared (copy-on-write).
+typedef struct CanvasTile {
+    SDL_atomic_t refcount;                                  // Number of owners
+    Uint32 pixels[CANVAS_TILE_SIZE * CANVAS_TILE_SIZE];     // ARGB8888, row-major
+} CanvasTile;
+
+// Tiles a single stroke replaced, with their contents before and after it.
+// Undo swaps the `before` tiles back in, redo the `after` tiles.
+typedef struct TileDelta {
+    int *indices;           // Tile indices (row-major) touched by the stroke
+    CanvasTile **before;    // Tile contents before the stroke
+    CanvasTile **after;     // Tile contents after the stroke (filled at end)
+    int count;              // Number of touched tiles
+    int capacity;           // Allocated capacity of the arrays
+    bool evicted;           // Tiles were dropped to stay within the memory budget
+} TileDelta;
+
+/**
+ * Allocates a tile filled with a single pixel value, with one reference.
+ *
+ * @param color Pixel value to fill with.
+ * @return      New tile, or NULL on allocation failure.
+ */
+CanvasTile *create_tile(Uint32 color);
+
+/**
+ * Allocates a private copy of a tile, with one reference.
+ *
+ * @param tile Tile to copy.
+ * @return     New tile, or NULL on allocation failure.
+ */
+CanvasTile *clone_tile(const CanvasTile *tile);
+
+/**
+ * Adds a reference to a tile.
+ *
+ * @param tile Tile to retain (may be NULL).
+ * @return     The same tile.
+ */
+CanvasTile *retain_tile(CanvasTile *tile);
+
+/**
+ * Drops a reference to a tile, freeing it when the last one goes.
+ *
+ * @param tile Tile to release (may be NULL).
+ */
+void release_tile(CanvasTile *tile);
+
+/**
+ * Checks whether a tile has more than one owner and must be copied before writing.
+ *
+ * @param tile Tile to inspect.
+ * @return     true if shared, false if exclusively owned.
+ */
+bool is_tile_shared(CanvasTile *tile);
+
+/**
+ * Initializes an empty TileDelta.
+ *
+ * @param delta Delta to initialize.
+ */
+void init_tile_delta(TileDelta *delta);
+
+/**
+ * Records the pre-stroke contents of a tile. Takes a new reference to `before`.
+ *
+ * @param delta  Delta to extend.
+ * @param index  Tile index in the canvas.
+ * @param before Tile contents before the stroke.
+ * @return       true on success, false on allocation failure.
+ */
+bool tile_delta_record(TileDelta *delta, int index, CanvasTile *before);
+
+/**
+ * Releases every tile held by a delta and frees its arrays.
+ *
+ * @param delta Delta to free.
+ */
+void free_tile_delta(TileDelta *delta);
+
+/**
+ * Releases the tiles of a delta to reclaim memory and marks it evicted.
+ * Undo and redo of the entry then fall back to replaying history.
+ *
+ * @param delta Delta to evict.
+ */
+void evict_tile_delta(TileDelta *delta);
+
+/**
+ * Estimates the memory kept alive by a delta: its `before` tiles, since the
+ * `after` tiles are normally shared with the canvas or the next entry.
+ *
+ * @param delta Delta to measure.
+ * @return      Size in bytes.
+ */
+size_t tile_delta_memory(const TileDelta *delta);
+
+#endif // TILE_H
@@ -19,6 +19,7 @@ typedef struct {
     // Window dimensions
     int window_width;
     int window_height;
+    int target_fps;                 // Presents per second; 0 follows the display refresh rate
 
     // Tool settings
     char default_tool[TOOL_NAME_MAX_LEN];
@@ -31,6 +32,19 @@ typedef struct {
     // Color palette
     SDL_Color palette_colors[MAX_PALETTE_COLORS];
     int palette_count;
+
+    // History settings
+    int history_memory_budget_mb;   // Memory for undo tiles and keyframes, in MiB
+    int history_resident_budget_mb; // Points, spans and text kept in RAM before spilling, in MiB (0 = never)
+    bool history_dedup_points;      // Drop repeated brush samples when a stroke ends
+    float history_simplify_tolerance; // Max deviation in pixels when simplifying strokes, 0 = off
+    int history_replay_threads;     // Threads replaying history into the canvas (0 = one per CPU)
+
+    // Autosave settings
+    bool autosave_enabled;          // Journal history changes next to the document
+    int autosave_checkpoint_entries; // Journaled changes after which the document is saved
+    int autosave_checkpoint_seconds; // Age of the oldest unsaved change that forces a save
+    int autosave_sync_ms;           // Longest a journaled change may wait for fdatasync
 } Config;
 
 /**
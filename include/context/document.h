@@ -0,0 +1,160 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <SDL2/SDL.h>
+#include "context/paint_context.h"
+
+// Identifies a MobPaint document; followed by the format version
+#define DOCUMENT_MAGIC "MOBPAINT"
+#define DOCUMENT_VERSION 1
+
+// Suffix of the autosave journal kept next to the document
+#define DOCUMENT_WAL_SUFFIX ".wal"
+
+typedef struct SaveJob SaveJob;
+
+// Native document at the target path. The file is a header followed by an
+// append-only log of records: canvas tiles, history entries and commit
+// markers. A save appends only the tiles and entries that changed since the
+// previous one and ends with a commit, so whatever follows the last commit
+// (a save cut short) is ignored on load. Loading maps the file and points
+// the history entries straight into the mapping.
+//
+// Saves are written by a worker thread; the frame loop only collects what
+// changed, and the worker reads the history entries to write in place while
+// the paint context keeps them pinned (see pin_history()). Between saves every history change is also appended to a
+// write-ahead journal next to the document, which is replayed on startup if
+// the session ended without saving. A save is the journal's checkpoint: once
+// it is committed the journal starts over. The header and records use native
+// byte order.
+typedef struct Document {
+    char *path;                 // Target file path
+    bool disabled;              // The file is not a document this build can write
+    bool read_only;             // Opened for rendering; nothing is ever written
+    bool has_file;              // The file was loaded or a full save was queued
+    int fd;                     // Open document file, -1 until the first save (worker)
+    Uint8 *map;                 // Read-only mapping of the loaded file, or NULL
+    size_t map_size;            // Length of the mapping
+    size_t end;                 // End of the last commit (worker)
+    Uint32 sequence;            // Sequence number of the last commit (worker)
+
+    CanvasTile **saved_tiles;   // Canvas tiles as of the last save, retained
+    int tile_count;             // Number of canvas tiles
+    Uint32 *saved_serials;      // Serials of the undo entries as of the last save
+    int saved_count;            // Number of undo entries as of the last save
+    int serial_capacity;        // Allocated capacity of saved_serials
+    int appended_tiles;         // Tile records appended since the file was last rewritten
+
+    bool autosave;              // History changes are journaled
+    int wal_fd;                 // Autosave journal, -1 without one (worker)
+    size_t wal_end;             // Bytes written to the journal (worker)
+    bool wal_failed;            // An append failed; wait for the next save (worker)
+    int sync_ms;                // Longest a journaled change waits for fdatasync
+    Uint32 *logged_serials;     // Serials of the undo then redo entries as last journaled
+    int logged_total;           // Number of serials in logged_serials
+    int logged_count;           // Undo entries as last journaled
+    int logged_capacity;        // Allocated capacity of logged_serials
+    Uint32 logged_version;      // Context history version as last journaled
+    int pending_changes;        // Changes journaled since the last save
+    Uint32 pending_since;       // Ticks when the oldest of them was journaled
+    int checkpoint_entries;     // Pending changes that trigger a save
+    Uint32 checkpoint_ms;       // Age of the oldest pending change that triggers a save
+
+    pthread_t worker;           // Thread writing queued saves
+    bool worker_running;        // `worker` was started
+    pthread_mutex_t lock;       // Guards the queue, `quit` and `failed`
+    pthread_cond_t wake;        // Signalled when a job is queued or on quit
+    pthread_cond_t idle;        // Signalled when the worker finishes a job
+    SaveJob *queue;             // Pending saves, oldest first
+    SaveJob *queue_tail;        // Last pending save
+    SaveJob *finished;          // Jobs the worker is done with, released on the main thread
+    int in_flight;              // Jobs queued or being written
+    bool quit;                  // Worker exits once the queue is drained
+    bool failed;                // A save failed; the next one rewrites the file
+} Document;
+
+/**
+ * Reads the canvas size stored in a document without loading it, so the
+ * window can be created at that size.
+ *
+ * @param path   Document path.
+ * @param width  Receives the canvas width.
+ * @param height Receives the canvas height.
+ * @return       true if `path` is a readable document, false otherwise.
+ */
+bool document_peek_size(const char *path, int *width, int *height);
+
+/**
+ * Opens the document at `path` and loads it into the context: the base
+ * raster becomes the first keyframe, the saved undo history is restored and
+ * the canvas shows the saved raster. A missing file starts an empty document
+ * that is created on the first save. A file that is not a valid document is
+ * left untouched and saving is disabled. Changes left in the autosave
+ * journal by a session that did not end cleanly are replayed on top and
+ * saved right away.
+ *
+ * @param document Document to initialize.
+ * @param path     Target file path.
+ * @param context  Freshly initialized paint context.
+ * @param config   Autosave settings.
+ * @return         false if the file exists but could not be loaded.
+ */
+bool open_document(Document *document, const char *path, PaintContext *context, const Config *config);
+
+/**
+ * Loads the document at `path` into the context like open_document(), but
+ * never writes to it or its autosave journal: changes left in the journal
+ * are replayed in memory only, no save thread is started and saving stays
+ * disabled. Used to render documents headlessly.
+ *
+ * @param document Document to initialize.
+ * @param path     Document path; it must exist.
+ * @param context  Freshly initialized paint context.
+ * @return         true if the document was loaded.
+ */
+bool open_document_read_only(Document *document, const char *path, PaintContext *context);
+
+/**
+ * Queues a save of the context's canvas and undo history. Only tiles and
+ * entries that changed since the previous save are collected; writing
+ * happens on the worker thread.
+ *
+ * @param document Open document.
+ * @param context  Paint context to save; no stroke may be in progress.
+ * @return         true if the save was queued or nothing changed.
+ */
+bool save_document(Document *document, PaintContext *context);
+
+/**
+ * Journals the history changes made since the previous call and saves the
+ * document once enough changes are pending or the oldest got too old.
+ * Called from the frame loop; it never waits for the disk.
+ *
+ * @param document Open document.
+ * @param context  Paint context.
+ */
+void autosave_document(Document *document, PaintContext *context);
+
+/**
+ * Waits until the worker has written every queued save and journal record,
+ * then releases the history pins they held. Call it before freeing the
+ * paint context.
+ *
+ * @param document Open document.
+ * @param context  Paint context the saves were queued for.
+ */
+void wait_for_saves(Document *document, PaintContext *context);
+
+/**
+ * Waits for queued saves to finish and closes the document. History entries
+ * loaded from the file point into its mapping, so the paint context must be
+ * freed first, after wait_for_saves().
+ *
+ * @param document Document to close.
+ */
+void close_document(Document *document);
+
+#endif // DOCUMENT_H
@@ -4,20 +4,23 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 #include "tools/tools.h"
+#include "canvas/tile.h"
+#include "context/point_stream.h"
 
-// Represents a 2D coordinate on the canvas
-typedef struct Point {
-    int x;
-    int y;
-} Point;
-
-// Represents a single drawing action (e.g., brush stroke)
+// Represents a single drawing action (e.g., brush stroke). Points are kept
+// raw while the stroke is drawn and encoded into `stream` once it ends.
 typedef struct {
-    Point *points;      // Dynamic array of drawn points
+    Point *points;      // Dynamic array of drawn points (NULL once committed)
     int count;          // Number of points currently stored
     int capacity;       // Allocated capacity of points array
+    PointStream stream; // Encoded points of a finished entry, from the context's pool
     Tool tool;          // Tool used for this entry
     char *text_data;    // Text content for TOOL_TEXT (NULL for other tools)
+    Span *spans;        // Filled spans for TOOL_FILL (NULL for other tools)
+    int span_count;     // Number of spans stored
+    TileDelta tiles;    // Canvas tiles before/after this entry, used by undo/redo
+    bool mapped;        // Stream, spans and text live in a read-only file mapping (journal or document)
+    Uint32 serial;      // Identifies the entry within the session
 } HistoryEntry;
 
 // Represents the history of drawing actions
@@ -42,21 +45,41 @@ void init_history(History *history);
 void free_history(History *history);
 
 /**
- * Pushes a new history entry onto the history stack.
+ * Frees everything an entry owns and leaves it empty.
+ *
+ * @param entry Pointer to the HistoryEntry.
+ */
+void free_history_entry(HistoryEntry *entry);
+
+/**
+ * Moves an entry onto the history stack. Nothing is copied: the history takes
+ * over the entry's points, spans, text and tile delta, and `entry` is left
+ * empty. On failure the caller still owns the entry.
  *
  * @param history Pointer to the History structure.
- * @param entry   The HistoryEntry to add.
+ * @param entry   The HistoryEntry to move in.
+ * @return true on success, false if the stack could not grow.
  */
-void push_history(History *history, HistoryEntry entry);
+bool push_history(History *history, HistoryEntry *entry);
 
 /**
- * Pops the most recent history entry from the stack.
- * If history is empty, the returned HistoryEntry may have count == 0.
+ * Makes room for `count` more entries, so that many pushes cannot fail.
  *
  * @param history Pointer to the History structure.
- * @return The last HistoryEntry.
+ * @param count   Number of entries about to be pushed.
+ * @return true on success, false if the stack could not grow.
  */
-HistoryEntry pop_history(History *history);
+bool reserve_history(History *history, int count);
+
+/**
+ * Moves the most recent entry off the history stack; the caller takes
+ * ownership of it.
+ *
+ * @param history Pointer to the History structure.
+ * @param entry   Receives the entry.
+ * @return true on success, false if the history is empty.
+ */
+bool pop_history(History *history, HistoryEntry *entry);
 
 /**
  * Checks if the history is empty.
@@ -76,4 +99,15 @@ bool is_history_empty(const History *history);
  */
 bool add_point_to_entry(HistoryEntry *entry, int x, int y);
 
+/**
+ * Appends spans to a given HistoryEntry. Used by TOOL_FILL, whose area is
+ * stored as runs instead of individual points.
+ *
+ * @param entry Pointer to the HistoryEntry.
+ * @param spans Spans to append.
+ * @param count Number of spans.
+ * @return true on success, false on failure (e.g., memory allocation failure).
+ */
+bool add_spans_to_entry(HistoryEntry *entry, const Span *spans, int count);
+
 #endif // HISTORY_H
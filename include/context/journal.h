@@ -0,0 +1,77 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "context/history.h"
+
+// Address space reserved for the journal mapping. Once a session has written
+// this much, further entries simply stay in memory.
+#define JOURNAL_MAX_SIZE (sizeof(void *) >= 8 ? ((size_t)4 << 30) : ((size_t)256 << 20))
+
+// Append-only file the replay data (points, fill spans, text) of old history
+// entries is moved to once the history holds more than its budget in RAM.
+// The file is mapped read-only, so a spilled entry's pointers lead straight
+// into the mapping and its pages fault back in only when it is replayed.
+typedef struct HistoryJournal {
+    int fd;                 // Unlinked temporary file, -1 until the first spill
+    Uint8 *map;             // Read-only mapping of JOURNAL_MAX_SIZE bytes
+    size_t size;            // Bytes appended so far
+    size_t resident;        // Replay data of undo/redo entries still in RAM
+    size_t budget;          // Resident bytes allowed before entries spill (0 = never)
+    int cursor;             // Undo entries below this index are all journaled
+    bool failed;            // The journal could not be created; stop trying
+} HistoryJournal;
+
+/**
+ * Initializes an empty journal. The backing file is created on first use.
+ *
+ * @param journal Journal to initialize.
+ * @param budget  Bytes of replay data to keep in RAM, 0 to never spill.
+ */
+void init_journal(HistoryJournal *journal, size_t budget);
+
+/**
+ * Unmaps and closes the journal. Entries pointing into it must be freed first.
+ *
+ * @param journal Journal to free.
+ */
+void free_journal(HistoryJournal *journal);
+
+/**
+ * Bytes of replay data an entry holds in RAM (0 once journaled).
+ *
+ * @param entry History entry.
+ * @return      Resident bytes.
+ */
+size_t entry_resident_size(const HistoryEntry *entry);
+
+/**
+ * Stops counting the resident data of entries that are about to be freed.
+ *
+ * @param journal Journal.
+ * @param history History whose entries are being discarded.
+ */
+void journal_forget(HistoryJournal *journal, const History *history);
+
+/**
+ * Counts a newly committed entry and spills the oldest resident undo entries
+ * until the history fits its budget again.
+ *
+ * @param journal    Journal.
+ * @param undo_stack Undo history; its top entry is the new one.
+ * @param spill      false to only count the entry, e.g. while saves read the
+ *                   resident data in place; journal_spill() catches up.
+ */
+void journal_commit(HistoryJournal *journal, History *undo_stack, bool spill);
+
+/**
+ * Spills the oldest resident undo entries until the history fits its
+ * budget again.
+ *
+ * @param journal    Journal.
+ * @param undo_stack Undo history.
+ */
+void journal_spill(HistoryJournal *journal, History *undo_stack);
+
+#endif // JOURNAL_H
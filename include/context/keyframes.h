@@ -0,0 +1,85 @@
+#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "canvas/canvas.h"
+#include "context/history.h"
+
+// Estimated pixel writes of replayed history after which a new keyframe is
+// taken. Cheap strokes get sparse keyframes, expensive ones (large brushes,
+// fills, text) get dense ones, so replaying to any position costs about the same.
+#define KEYFRAME_REPLAY_COST (8L * 1024 * 1024)
+
+// Canvas state after the first `position` undo entries were applied
+typedef struct Keyframe {
+    int position;           // Number of undo entries the snapshot includes
+    Canvas *snapshot;       // Tile-sharing copy of the canvas at that point
+    size_t memory;          // Bytes of tiles not shared with the previous keyframe
+} Keyframe;
+
+// Raster snapshots of the undo history. While an entry still owns its tile
+// delta, undo and redo just swap tiles; once deltas are evicted to stay under
+// the memory budget the canvas is rebuilt from the nearest earlier keyframe.
+//
+// The memory in use is kept as a running total of the undo and redo tile
+// deltas plus each keyframe's tiles it does not share with the keyframe
+// before it, so commits never walk the whole history.
+typedef struct KeyframeCache {
+    Keyframe *frames;       // Keyframes ordered by position, frames[0] is the blank canvas
+    int count;              // Number of keyframes
+    int capacity;           // Allocated capacity of frames
+    long replay_cost;       // Estimated cost of entries since the last keyframe
+    size_t memory;          // Bytes tile deltas and keyframes keep alive
+    int evicted;            // Undo entries below this index have evicted deltas
+    size_t memory_budget;   // Bytes tile deltas and keyframes may keep alive
+} KeyframeCache;
+
+/**
+ * Initializes the cache with a keyframe of the blank canvas at position 0.
+ *
+ * @param cache         Cache to initialize.
+ * @param blank         Canvas before any history was applied.
+ * @param memory_budget Bytes tile deltas and keyframes may keep alive.
+ * @return              true on success, false on allocation failure.
+ */
+bool init_keyframes(KeyframeCache *cache, const Canvas *blank, size_t memory_budget);
+
+/**
+ * Frees every keyframe held by the cache.
+ *
+ * @param cache Cache to free.
+ */
+void free_keyframes(KeyframeCache *cache);
+
+/**
+ * Drops keyframes past `position` and stops counting the tile deltas of the
+ * redo history. Called when the redo history is about to be discarded.
+ *
+ * @param cache     Cache to truncate.
+ * @param position  Last undo position that is still valid.
+ * @param discarded Redo history that is being discarded, or NULL.
+ */
+void keyframes_truncate(KeyframeCache *cache, int position, const History *discarded);
+
+/**
+ * Accounts for the entry just pushed onto the undo stack, takes a keyframe
+ * once enough replay cost accumulated, then evicts the oldest tile deltas
+ * and keyframes until the history fits the memory budget.
+ *
+ * @param cache      Keyframe cache.
+ * @param canvas     Live canvas, showing the state after the new entry.
+ * @param undo_stack Undo history, with the new entry on top.
+ */
+void keyframes_commit(KeyframeCache *cache, const Canvas *canvas, History *undo_stack);
+
+/**
+ * Finds the keyframe closest to and not after a history position.
+ *
+ * @param cache    Keyframe cache.
+ * @param position Number of undo entries the wanted state includes.
+ * @return         Keyframe to replay from, or NULL if the cache is empty.
+ */
+const Keyframe *find_keyframe(const KeyframeCache *cache, int position);
+
+#endif // KEYFRAMES_H
@@ -3,23 +3,29 @@
 
 #include <stdbool.h>
 
+// Logging never waits for the disk. Messages are formatted on the calling
+// thread into a lock-free ring buffer and written in batches by a background
+// thread, which also prunes old history logs. When the ring is full a
+// message is dropped; the writer notes how many in the log it was meant for.
+
 /**
  * Initializes the logging system.
- * Creates or opens necessary log files.
+ * Creates or opens necessary log files and starts the writer thread.
  *
  * @return true if initialization is successful, false otherwise.
  */
 bool init_logs(void);
 
 /**
- * Closes and flushes all open log files.
- * Should be called before program termination.
+ * Writes out every queued message, stops the writer thread and closes the
+ * log files. Should be called before program termination, once no other
+ * thread logs anymore.
  */
 void close_logs(void);
 
 /**
  * Logs an error message to the error log file.
- * Accepts printf-style formatting.
+ * Accepts printf-style formatting; messages longer than 511 bytes are cut short.
  *
  * @param format Format string.
  * @param ...    Format arguments.
@@ -28,7 +34,7 @@ void log_error(const char *format, ...);
 
 /**
  * Logs an informational message to the history log file.
- * Accepts printf-style formatting.
+ * Accepts printf-style formatting; messages longer than 511 bytes are cut short.
  *
  * @param format Format string.
  * @param ...    Format arguments.
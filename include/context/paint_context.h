@@ -4,22 +4,33 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 #include "tools/tools.h"
+#include "canvas/canvas.h"
 #include "context/history.h"
+#include "context/keyframes.h"
+#include "context/journal.h"
 #include "config.h"
 
-// Threshold to decide when to cache the bitmap for performance
-#define CACHE_THRESHOLD 1000
-
 typedef struct PaintContext {
-    SDL_Renderer *renderer;         // SDL renderer for drawing
-    SDL_Texture *bitmap_cache;      // Cached texture for optimized redraws
+    SDL_Renderer *renderer;         // SDL renderer the UI chrome is drawn with
+    Canvas *canvas;                 // Tiled CPU-side pixels all tools draw into
+    Uint32 background;              // Background pixel value of an empty canvas
     int mouse_x;                    // Current mouse X position
     int mouse_y;                    // Current mouse Y position
     Tool current_tool;              // Currently selected drawing tool
     History *undo_stack;            // Stack holding undo history entries
     History *redo_stack;            // Stack holding redo history entries
-    HistoryEntry *current_stroke;   // Points collected in the current stroke
-    int committed_stroke_count;    // Count of finalized strokes
+    HistoryEntry *current_stroke;   // Points collected in the current stroke (&stroke or NULL)
+    HistoryEntry stroke;            // Storage for the current stroke, reused between strokes
+    PointPool point_pool;           // Arena the encoded points of all history entries come from
+    HistoryJournal journal;         // On-disk spill area for old entries' replay data
+    Uint32 next_serial;             // Serial given to the next committed entry
+    Uint32 history_version;         // Bumped whenever the undo or redo history changes
+    KeyframeCache keyframes;        // Canvas snapshots used once tile deltas are evicted
+    int history_pins;               // Queued saves reading history entries in place
+    History retired;                // Entries discarded while pinned, freed once unpinned
+    bool dedup_points;              // Drop repeated brush samples when a stroke ends
+    float simplify_tolerance;       // Max deviation in pixels when simplifying strokes, 0 = off
+    int replay_threads;             // Threads replaying history (0 = one per CPU)
     
     // Text input state
     bool text_input_active;         // Whether text input is active
@@ -40,7 +51,8 @@ typedef struct PaintContext {
 void init_paint_context(SDL_Renderer *renderer, PaintContext *paint_context, Config *config, Tool current_tool);
 
 /**
- * Starts a new stroke (drawing action).
+ * Starts a new stroke (drawing action) and begins recording the canvas
+ * tiles it modifies. An unfinished previous stroke is ended first.
  *
  * @param paint_context Pointer to PaintContext.
  */
@@ -55,6 +67,16 @@ void start_stroke(PaintContext *paint_context);
  */
 void add_point_to_current_stroke(PaintContext *paint_context, int x, int y);
 
+/**
+ * Appends several points to the current stroke with a single reallocation.
+ *
+ * @param paint_context Pointer to PaintContext.
+ * @param points        Points to append.
+ * @param count         Number of points.
+ * @return true on success, false if there is no stroke or memory ran out.
+ */
+bool add_points_to_current_stroke(PaintContext *paint_context, const Point *points, int count);
+
 /**
  * Ends the current stroke and commits it to undo history.
  *
@@ -62,6 +84,35 @@ void add_point_to_current_stroke(PaintContext *paint_context, int x, int y);
  */
 void end_stroke(PaintContext *paint_context);
 
+/**
+ * Abandons the current stroke: the tiles it changed are restored and
+ * nothing is added to the history.
+ *
+ * @param paint_context Pointer to PaintContext.
+ */
+void cancel_stroke(PaintContext *paint_context);
+
+/**
+ * Draws a finished entry onto the canvas and commits it to the undo history
+ * as if it had just been drawn, e.g. when recovering autosaved history. The
+ * history takes over the entry; its stream must come from the context's pool.
+ *
+ * @param paint_context Pointer to PaintContext; no stroke may be in progress.
+ * @param entry         Entry to commit, left empty.
+ * @return true on success, false otherwise (the entry is freed and its
+ *         drawing taken back off the canvas).
+ */
+bool commit_history_entry(PaintContext *paint_context, HistoryEntry *entry);
+
+/**
+ * Clears the canvas to the background color as an undoable history entry.
+ *
+ * @param paint_context Pointer to PaintContext; no stroke may be in progress.
+ * @return true if the clear was committed, false if a stroke is in progress
+ *         or it failed.
+ */
+bool clear_canvas(PaintContext *paint_context);
+
 /**
  * Updates the current mouse coordinates.
  *
@@ -96,14 +147,43 @@ bool paint_context_undo(PaintContext *paint_context);
 bool paint_context_redo(PaintContext *paint_context);
 
 /**
- * Redraws the entire canvas, including committed strokes.
+ * Rebuilds the canvas from the nearest keyframe by replaying the undo entries
+ * after it, tile-parallel (see replay_history()). Undo and redo only need
+ * this once an entry's tiles were evicted.
  *
  * @param paint_context Pointer to PaintContext.
  */
 void redraw_canvas(PaintContext *paint_context);
 
 /**
- * Frees all allocated resources in PaintContext.
+ * Replays a single history entry into a canvas.
+ *
+ * @param canvas Canvas to draw into.
+ * @param entry  History entry to apply.
+ */
+void apply_history_entry(Canvas *canvas, const HistoryEntry *entry);
+
+/**
+ * Keeps the replay data of every history entry where it is until the
+ * matching unpin_history(), so a save thread can read it in place: entries
+ * the history discards meanwhile are kept aside and nothing is spilled to
+ * the journal. Pins nest.
+ *
+ * @param paint_context Pointer to PaintContext.
+ */
+void pin_history(PaintContext *paint_context);
+
+/**
+ * Releases a pin_history(). With the last pin gone the entries discarded
+ * meanwhile are freed and the spilling to the journal catches up.
+ *
+ * @param paint_context Pointer to PaintContext.
+ */
+void unpin_history(PaintContext *paint_context);
+
+/**
+ * Frees all allocated resources in PaintContext. The history must not be
+ * pinned.
  *
  * @param paint_context Pointer to PaintContext.
  */
@@ -0,0 +1,136 @@
+#ifndef POINT_STREAM_H
+#define POINT_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+// Represents a 2D coordinate on the canvas
+typedef struct Point {
+    int x;
+    int y;
+} Point;
+
+// Payload bytes of a pooled chunk; longer streams get a chunk of their own
+#define POINT_CHUNK_SIZE (64 * 1024)
+
+typedef struct PointPool PointPool;
+
+// Block of stream storage. Streams are carved from it back to back and the
+// chunk is released (or recycled) once the last of them is freed.
+typedef struct PointChunk {
+    PointPool *pool;    // Pool the chunk belongs to
+    size_t size;        // Payload capacity in bytes
+    size_t used;        // Payload bytes handed out
+    int streams;        // Live streams stored in the chunk
+    Uint8 data[];       // Payload
+} PointChunk;
+
+// Arena the encoded stroke points of one history are allocated from, so
+// long sessions make a few large allocations instead of one per stroke.
+struct PointPool {
+    PointChunk *current;    // Chunk new streams are carved from
+    PointChunk *spare;      // Emptied chunk kept for reuse
+};
+
+// Stroke points stored compactly: each point is the zigzag-encoded delta to
+// the previous one (the first to the origin) as two LEB128 varints. Mouse
+// samples move a few pixels at a time, so most points take two bytes.
+typedef struct PointStream {
+    Uint8 *data;        // Encoded deltas
+    size_t size;        // Number of bytes in data
+    int count;          // Number of encoded points
+    PointChunk *chunk;  // Pool chunk holding data
+} PointStream;
+
+// Cursor decoding a PointStream front to back
+typedef struct PointReader {
+    const Uint8 *next;  // Next byte to decode
+    const Uint8 *end;   // End of the encoded data
+    int remaining;      // Points not yet decoded
+    Point point;        // Most recently decoded point
+} PointReader;
+
+/**
+ * Initializes an empty pool.
+ *
+ * @param pool Pool to initialize.
+ */
+void init_point_pool(PointPool *pool);
+
+/**
+ * Frees the pool's chunks. Every stream allocated from it must have been
+ * freed first.
+ *
+ * @param pool Pool to free.
+ */
+void free_point_pool(PointPool *pool);
+
+/**
+ * Encodes points into a stream allocated from a pool.
+ *
+ * @param stream Stream to fill; its previous contents are not freed.
+ * @param pool   Pool to allocate from.
+ * @param points Points to encode.
+ * @param count  Number of points.
+ * @return       true on success, false on allocation failure (stream left empty).
+ */
+bool encode_points(PointStream *stream, PointPool *pool, const Point *points, int count);
+
+/**
+ * Copies an encoded stream, e.g. one read from a file, into a pool.
+ *
+ * @param stream Stream to fill; its previous contents are not freed.
+ * @param pool   Pool to allocate from.
+ * @param source Stream to copy.
+ * @return       true on success, false on allocation failure (stream left empty).
+ */
+bool copy_point_stream(PointStream *stream, PointPool *pool, const PointStream *source);
+
+/**
+ * Returns a stream's storage to its pool and leaves the stream empty.
+ *
+ * @param stream Stream to free.
+ */
+void free_point_stream(PointStream *stream);
+
+/**
+ * Starts decoding a stream from its first point.
+ *
+ * @param reader Reader to initialize.
+ * @param stream Stream to decode (must outlive the reader).
+ */
+void init_point_reader(PointReader *reader, const PointStream *stream);
+
+/**
+ * Decodes the next point.
+ *
+ * @param reader Reader.
+ * @param point  Receives the point.
+ * @return       false once all points were read or the data is truncated.
+ */
+bool read_point(PointReader *reader, Point *point);
+
+/**
+ * Removes consecutive repeated points in place. A brush dab at a repeated
+ * sample is already covered by the previous one, so this is lossless.
+ *
+ * @param points Points to compact.
+ * @param count  Number of points.
+ * @return       New number of points.
+ */
+int dedup_points(Point *points, int count);
+
+/**
+ * Simplifies a polyline in place with Ramer-Douglas-Peucker: points closer
+ * than `tolerance` pixels to the simplified path are dropped. The first and
+ * last points are always kept.
+ *
+ * @param points    Points to simplify.
+ * @param count     Number of points.
+ * @param tolerance Maximum distance in pixels a dropped point may deviate.
+ * @return          New number of points.
+ */
+int simplify_points(Point *points, int count, float tolerance);
+
+#endif // POINT_STREAM_H
@@ -0,0 +1,112 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+// Frame timing probes. Built with MOBPAINT_PROFILE defined, PROFILE_SCOPE()
+// times the rest of the enclosing block and records it into a ring buffer
+// owned by the calling thread; without it the probes expand to nothing and
+// the functions below are empty inlines.
+//
+// Each thread keeps its last PROFILE_RING_SIZE zones, which
+// profile_dump_trace() writes out as Chrome trace event JSON (load it in
+// chrome://tracing or Perfetto). The durations of the last
+// PROFILE_FRAME_HISTORY frames are kept for the on-screen overlay.
+
+// Zones each thread keeps before the oldest are overwritten
+#define PROFILE_RING_SIZE 16384
+
+// Frames whose durations are kept for the percentiles
+#define PROFILE_FRAME_HISTORY 240
+
+// Frame time percentiles over the recent frames, in milliseconds
+typedef struct {
+    int frames;     // Frames measured, at most PROFILE_FRAME_HISTORY
+    double p50;
+    double p95;
+    double p99;
+    double max;
+} FrameStats;
+
+#ifdef MOBPAINT_PROFILE
+
+// An open zone; closed when the variable goes out of scope
+typedef struct {
+    const char *name;   // Static string naming the zone
+    Uint64 start;       // Performance counter when the zone opened
+} ProfileZone;
+
+/**
+ * Opens a zone. Use PROFILE_SCOPE() rather than calling this directly.
+ *
+ * @param name Zone name; must outlive the process (a string literal).
+ * @return     The open zone.
+ */
+ProfileZone profile_begin(const char *name);
+
+/**
+ * Closes a zone and records it in the calling thread's ring buffer.
+ *
+ * @param zone Zone opened by profile_begin().
+ */
+void profile_end(ProfileZone *zone);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// Times from here to the end of the enclosing block, early returns included
+#define PROFILE_SCOPE(name) \
+    __attribute__((cleanup(profile_end))) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__) = profile_begin(name)
+
+/**
+ * Names the calling thread in exported traces. Threads that never call this
+ * are listed by number.
+ *
+ * @param name Thread name; copied.
+ */
+void profile_thread_name(const char *name);
+
+/**
+ * Marks the start of a frame's work on the main thread.
+ */
+void profile_begin_frame(void);
+
+/**
+ * Ends the frame opened by profile_begin_frame(), recording it as a "frame"
+ * zone and adding its duration to the frame history. Frames that never
+ * present should not call this.
+ */
+void profile_end_frame(void);
+
+/**
+ * Computes percentiles over the recent frame durations.
+ *
+ * @param stats Receives the percentiles.
+ * @return      true if at least one frame was measured.
+ */
+bool profile_frame_stats(FrameStats *stats);
+
+/**
+ * Writes every thread's recorded zones to `path` as Chrome trace event JSON.
+ * Threads may keep recording while the dump runs; zones overwritten during
+ * the copy are left out.
+ *
+ * @param path Output file.
+ * @return     true if the trace was written.
+ */
+bool profile_dump_trace(const char *path);
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+
+static inline void profile_thread_name(const char *name) { (void)name; }
+static inline void profile_begin_frame(void) {}
+static inline void profile_end_frame(void) {}
+static inline bool profile_frame_stats(FrameStats *stats) { (void)stats; return false; }
+static inline bool profile_dump_trace(const char *path) { (void)path; return false; }
+
+#endif // MOBPAINT_PROFILE
+
+#endif // PROFILE_H
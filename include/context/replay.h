@@ -0,0 +1,33 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "canvas/canvas.h"
+#include "context/history.h"
+
+// Runs shorter than this are replayed on the calling thread; starting
+// workers costs more than they would save.
+#define REPLAY_PARALLEL_MIN_ENTRIES 4
+
+// Most threads a single replay uses
+#define REPLAY_MAX_THREADS 64
+
+/**
+ * Replays history entries into a canvas, oldest first. The canvas is cut
+ * into bands of tile rows that worker threads take one at a time; a band
+ * replays, in history order, only the entries whose rows reach it, with
+ * writes clipped to the band. No two bands share a tile and every pixel
+ * sees the entries that cover it in the original order, so the result is
+ * identical to applying the entries one by one.
+ *
+ * Text entries draw through the font cache, which is not thread-safe, and
+ * clears replace every tile; both are applied on the calling thread between
+ * the parallel runs.
+ *
+ * @param canvas  Canvas to draw into. While it is recording, replay is serial.
+ * @param entries Entries to replay.
+ * @param count   Number of entries.
+ * @param threads Threads to use, 0 for one per CPU core, 1 for serial replay.
+ */
+void replay_history(Canvas *canvas, const HistoryEntry *entries, int count, int threads);
+
+#endif // REPLAY_H
@@ -0,0 +1,20 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "context/config.h"
+
+/**
+ * Renders a document to an image without opening a window. The document
+ * and any unsaved changes in its autosave journal are loaded read-only,
+ * then the canvas is rebuilt from the document's base raster by replaying
+ * the whole history through the regular tool and raster code and written
+ * out. Images ending in .bmp are saved as BMP, anything else as PNG.
+ *
+ * @param document_path Document to render; it is not modified.
+ * @param image_path    Image file to write.
+ * @param config        Application settings (canvas defaults, history limits).
+ * @return              0 on success, non-zero on failure.
+ */
+int run_headless(const char *document_path, const char *image_path, Config *config);
+
+#endif // HEADLESS_H
@@ -0,0 +1,129 @@
+#ifndef INPUT_RECORD_H
+#define INPUT_RECORD_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "canvas/canvas.h"
+
+// Identifies an input recording; followed by the format version
+#define INPUT_MAGIC "MOBINPUT"
+#define INPUT_VERSION 1
+
+// Input sessions. A recording is a header (canvas size and checksum at the
+// start) followed by one record per input event the app handled, in order:
+// a kind byte, the milliseconds since the previous record as a varint and
+// the fields the app reads from the event, with coordinates as zigzag
+// varints. Frame records mark where a frame was presented, so a replay
+// batches input into frames exactly as the session did and ends up with
+// the same canvas; an end record carries the final canvas checksum. The
+// header uses native byte order.
+
+// Writes the app's input events to a file as they are handled
+typedef struct {
+    FILE *file;         // Open recording, NULL if recording failed
+    Uint32 last_ticks;  // SDL ticks of the previous record
+    int last_x;         // Mouse position of the previous record
+    int last_y;
+} InputRecorder;
+
+// Feeds a recording back into the app
+typedef struct {
+    Uint8 *data;            // Whole recording
+    size_t size;            // Length of `data`
+    size_t offset;          // Next record
+    bool realtime;          // Wait for each record's original time
+    Uint32 start_ticks;     // SDL ticks when the replay started
+    Uint32 elapsed_ms;      // Recorded time of the next record, from the start
+    int last_x;             // Mouse position of the previous record
+    int last_y;
+    bool frame;             // The last next_input_event() stopped at a frame record
+    bool finished;          // The end of the recording was reached
+    bool has_checksum;      // The recording ended cleanly with the final checksum
+    Uint32 checksum;        // Canvas checksum at the end of the recorded session
+
+    int events;             // Events replayed
+    int frames;             // Frames presented
+    double frame_ms;        // Time spent on those frames
+    double max_frame_ms;    // Longest of them
+    double wait_ms;         // Realtime waiting since the last frame, not counted in it
+    Uint64 started;         // Performance counter when the replay started
+} InputReplay;
+
+/**
+ * Creates a recording at `path` for a session starting on `canvas`.
+ *
+ * @param recorder Recorder to initialize.
+ * @param path     Output file; replaced if it exists.
+ * @param canvas   Canvas as the session starts.
+ * @return         true if the file was created.
+ */
+bool open_input_recording(InputRecorder *recorder, const char *path, const Canvas *canvas);
+
+/**
+ * Appends an event. Events the app does not act on are skipped.
+ *
+ * @param recorder Open recorder.
+ * @param event    Event about to be handled.
+ */
+void record_input_event(InputRecorder *recorder, const SDL_Event *event);
+
+/**
+ * Marks that a frame was presented after the events recorded so far.
+ *
+ * @param recorder Open recorder.
+ */
+void record_input_frame(InputRecorder *recorder);
+
+/**
+ * Ends the recording with the final canvas checksum and closes it.
+ *
+ * @param recorder Recorder to close.
+ * @param canvas   Canvas as the session ends.
+ */
+void close_input_recording(InputRecorder *recorder, const Canvas *canvas);
+
+/**
+ * Loads a recording to replay on `canvas`, which must have the recorded
+ * size. A canvas that does not start out as the recorded one is only
+ * reported, since the replay still measures the same work.
+ *
+ * @param replay   Replay to initialize.
+ * @param path     Recording to load.
+ * @param canvas   Canvas the events will draw on.
+ * @param realtime Replay at the recorded pace instead of as fast as possible.
+ * @return         true if the recording was loaded.
+ */
+bool open_input_replay(InputReplay *replay, const char *path, const Canvas *canvas, bool realtime);
+
+/**
+ * Returns the next recorded event. Stops at frame records, setting
+ * `replay->frame`, and at the end of the recording, setting
+ * `replay->finished`. With realtime replay it waits until the record's time.
+ *
+ * @param replay Open replay.
+ * @param event  Receives the event.
+ * @return       true if an event was returned.
+ */
+bool next_input_event(InputReplay *replay, SDL_Event *event);
+
+/**
+ * Adds a presented frame to the replay's timing.
+ *
+ * @param replay Open replay.
+ * @param ms     Time from the end of the previous frame to the present; realtime
+ *               waits in between are taken out.
+ */
+void input_replay_frame_done(InputReplay *replay, double ms);
+
+/**
+ * Reports the replay's timing and whether the final canvas matches the
+ * recorded session (stdout and the session log), then frees the replay.
+ *
+ * @param replay Replay to close.
+ * @param canvas Canvas as the replay ends.
+ * @return       false if the recording has a final checksum and the canvas differs.
+ */
+bool close_input_replay(InputReplay *replay, const Canvas *canvas);
+
+#endif // INPUT_RECORD_H
@@ -33,6 +33,17 @@
 
 extern Assets *global_assets;
 
+// Topbar and sidebar rendered once into textures, so frames only copy them.
+// They are re-rendered when the tool, color or size they show changes.
+typedef struct ChromeCache {
+    SDL_Texture *topbar;    // TOPBAR_HEIGHT-high strip across the window
+    SDL_Texture *sidebar;   // SIDEBAR_WIDTH-wide strip down the window
+    bool valid;             // Whether the textures match the state below
+    ToolType tool_type;     // Tool shown when last rendered
+    int tool_size;          // Brush size shown when last rendered
+    SDL_Color tool_color;   // Color highlighted when last rendered
+} ChromeCache;
+
 /**
  * Checks if the given (x, y) position is within the left sidebar area.
  *
@@ -81,4 +92,47 @@ void draw_color_palette(SDL_Renderer *renderer, PaintContext *context, Config *c
  */
 void handle_color_palette_click(PaintContext *context, Config *config, int mouse_x, int mouse_y);
 
+/**
+ * Creates the chrome textures. If the renderer cannot render to textures
+ * the cache stays empty and draw_chrome() draws directly every time.
+ *
+ * @param cache    Cache to initialize.
+ * @param renderer SDL renderer the chrome is drawn with.
+ * @param config   Pointer to the current configuration.
+ */
+void init_chrome_cache(ChromeCache *cache, SDL_Renderer *renderer, Config *config);
+
+/**
+ * Re-renders the cached chrome if the state it shows has changed.
+ * Must be called without a clip rectangle set.
+ *
+ * @param cache    Chrome cache.
+ * @param renderer SDL renderer the chrome is drawn with.
+ * @param context  Pointer to the current PaintContext.
+ * @param config   Pointer to the current configuration.
+ * @param font     Font used for the size label.
+ * @return         true if the chrome changed and must be presented again.
+ */
+bool update_chrome_cache(ChromeCache *cache, SDL_Renderer *renderer, PaintContext *context,
+                         Config *config, TTF_Font *font);
+
+/**
+ * Draws the topbar and sidebar, copying the cached textures when available.
+ *
+ * @param cache    Chrome cache.
+ * @param renderer SDL renderer to draw with.
+ * @param context  Pointer to the current PaintContext.
+ * @param config   Pointer to the current configuration.
+ * @param font     Font used for the size label.
+ */
+void draw_chrome(ChromeCache *cache, SDL_Renderer *renderer, PaintContext *context,
+                 Config *config, TTF_Font *font);
+
+/**
+ * Destroys the chrome textures.
+ *
+ * @param cache Chrome cache.
+ */
+void free_chrome_cache(ChromeCache *cache);
+
 #endif // SIDEBAR_H
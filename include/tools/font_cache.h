@@ -0,0 +1,99 @@
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+// Point size of the UI font (the size label in the top bar)
+#define UI_FONT_SIZE 16
+
+// Width of a face's glyph atlas in pixels; its height grows as needed
+#define GLYPH_ATLAS_WIDTH 1024
+
+// A rasterized glyph stored as 8-bit coverage in its face's atlas
+typedef struct Glyph {
+    Uint16 codepoint;   // Unicode code point (BMP)
+    int x;              // Left edge of the bitmap in the atlas
+    int y;              // Top edge of the bitmap in the atlas
+    int w;              // Bitmap width
+    int h;              // Bitmap height (the font's line height)
+    int offset_x;       // Bitmap left edge relative to the pen position
+    int advance;        // Horizontal pen advance
+} Glyph;
+
+// An opened font at one point size plus every glyph rasterized from it so far
+typedef struct FontFace {
+    int size;                   // Point size the font was opened at
+    TTF_Font *font;             // Open SDL_ttf handle
+    int height;                 // Line height in pixels
+
+    Glyph *glyphs;              // Rasterized glyphs, in order of first use
+    int glyph_count;            // Number of glyphs
+    int glyph_capacity;         // Allocated capacity of glyphs
+    int latin[256];             // Index + 1 into glyphs for code points < 256, 0 if absent
+
+    Uint8 *atlas;               // GLYPH_ATLAS_WIDTH x atlas_height coverage bitmap
+    int atlas_height;           // Current atlas height in pixels
+    int shelf_x;                // Next free column on the current shelf
+    int shelf_y;                // Top of the current shelf
+    Uint32 atlas_version;       // Bumped whenever glyphs are added to the atlas
+
+    struct FontFace *next;      // Next cached face
+} FontFace;
+
+/**
+ * Returns the embedded font (asset_pack.h) at a point size, opening it on
+ * first use. The UI, the text tool and its preview share these faces, which
+ * stay cached until free_font_cache().
+ *
+ * @param size Point size.
+ * @return     Cached face, or NULL if the font could not be opened.
+ */
+FontFace *get_font_face(int size);
+
+/**
+ * Returns a glyph, rasterizing it into the face's atlas on first use.
+ * May grow (and move) the atlas; the pointer stays valid until the next call.
+ *
+ * @param face      Font face.
+ * @param codepoint Unicode code point.
+ * @return          Glyph, or NULL if it could not be rasterized.
+ */
+const Glyph *get_glyph(FontFace *face, Uint16 codepoint);
+
+/**
+ * Decodes the next UTF-8 character and advances the string pointer.
+ * Characters outside the BMP and malformed bytes decode as '?'.
+ *
+ * @param text Pointer into a NUL-terminated UTF-8 string.
+ * @return     Decoded code point, or 0 at the end of the string.
+ */
+Uint16 next_codepoint(const char **text);
+
+/**
+ * Computes the size of a line of text as laid out by render_text().
+ *
+ * @param face Font face.
+ * @param text UTF-8 text.
+ * @param w    Receives the width in pixels (may be NULL).
+ * @param h    Receives the line height in pixels (may be NULL).
+ */
+void measure_text(FontFace *face, const char *text, int *w, int *h);
+
+/**
+ * Kerning adjustment between two consecutive code points.
+ *
+ * @param face     Font face.
+ * @param previous Previous code point, or 0 at the start of the line.
+ * @param current  Current code point.
+ * @return         Pen adjustment in pixels.
+ */
+int glyph_kerning(FontFace *face, Uint16 previous, Uint16 current);
+
+/**
+ * Closes every cached font and frees the glyph atlases.
+ */
+void free_font_cache(void);
+
+#endif // FONT_CACHE_H
@@ -4,11 +4,15 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include "context/config.h"
+#include "canvas/canvas.h"
+#include "tools/font_cache.h"
 
 typedef struct PaintContext PaintContext;
 
 typedef struct Point Point;
 
+typedef struct PointStream PointStream;
+
 // Supported drawing tool types
 typedef enum {
     TOOL_BRUSH = 0,
@@ -17,9 +21,10 @@ typedef enum {
     TOOL_CIRCLE = 3,
     TOOL_FILL = 4,
     TOOL_TEXT = 5,
-    TOOL_COUNT = 6, // Always at the bottom
+    TOOL_COUNT = 6, // Always at the bottom of the selectable tools
     // TOOL_RECT,
     // TOOL_COUNT
+    TOOL_CLEAR = TOOL_COUNT, // History entries of a cleared canvas; not a selectable tool
 } ToolType;
 
 // Represents the current drawing tool's configuration
@@ -56,43 +61,87 @@ void set_tool_type(Tool *tool, ToolType type);
 void use_tool(PaintContext *context, int prev_x, int prev_y);
 
 /**
- * Draws a thick line between two points with the specified size.
+ * Continues the current brush or eraser stroke through a batch of pointer
+ * samples. The samples are appended to the stroke in one step and the path
+ * from the previous sample through them is drawn with draw_thick_polyline().
+ * Other tools ignore the batch.
+ *
+ * @param context Pointer to the PaintContext.
+ * @param points  New samples, in input order.
+ * @param count   Number of samples.
+ */
+void extend_stroke(PaintContext *context, const Point *points, int count);
+
+/**
+ * Draws a thick line between two points with the specified size. The brush
+ * is a disc swept along the segment (a capsule), filled one span per row so
+ * each pixel is written once. Equal end points draw a single dab.
  *
- * @param renderer SDL renderer to use.
+ * @param canvas   Canvas to draw into.
  * @param x1       Start X position.
  * @param y1       Start Y position.
  * @param x2       End X position.
  * @param y2       End Y position.
  * @param size     Line thickness.
+ * @param color    Pixel value to draw with (see canvas_map_color).
+ */
+void draw_thick_line(Canvas *canvas, int x1, int y1, int x2, int y2, int size, Uint32 color);
+
+/**
+ * Draws a thick polyline as one joined path. Every row is filled with the
+ * union of the segment capsules crossing it, so pixels shared by adjacent
+ * segments (or where the path crosses itself) are written once.
+ *
+ * @param canvas   Canvas to draw into.
+ * @param points   Path vertices.
+ * @param count    Number of vertices; a single vertex draws a dab.
+ * @param size     Line thickness.
+ * @param color    Pixel value to draw with (see canvas_map_color).
+ */
+void draw_thick_polyline(Canvas *canvas, const Point *points, int count, int size, Uint32 color);
+
+/**
+ * Draws an encoded stroke like draw_thick_polyline(), decoding its points
+ * directly into the rasterizer.
+ *
+ * @param canvas   Canvas to draw into.
+ * @param stream   Encoded path vertices.
+ * @param size     Line thickness.
+ * @param color    Pixel value to draw with (see canvas_map_color).
  */
-void draw_thick_line(SDL_Renderer *renderer, int x1, int y1, int x2, int y2, int size);
+void draw_encoded_polyline(Canvas *canvas, const PointStream *stream, int size, Uint32 color);
 
 /**
  * Draws a thick circle outline between two points using bounding box logic.
+ * The ring is rasterized as horizontal spans with integer arithmetic and no
+ * allocations, so each covered pixel is written once.
  *
- * @param renderer SDL renderer to use.
+ * @param canvas   Canvas to draw into.
  * @param x1       First point (defines center/radius).
  * @param y1       First point.
  * @param x2       Second point (defines radius).
  * @param y2       Second point.
  * @param size     Circle outline thickness.
+ * @param color    Pixel value to draw with (see canvas_map_color).
  */
-void draw_thick_circle(SDL_Renderer *renderer, int x1, int y1, int x2, int y2, int size);
+void draw_thick_circle(Canvas *canvas, int x1, int y1, int x2, int y2, int size, Uint32 color);
 
 /**
- * Performs flood fill (bucket fill) operation starting at a given pixel.
- * Optionally outputs the filled pixels list via `out_points`.
+ * Performs a scanline flood fill (bucket fill) starting at a given pixel.
+ * The color to be replaced is the one currently under the start pixel.
+ * The canvas is read once; the work stack holds one seed per span edge,
+ * so memory grows with the region's shape rather than its area.
+ * Optionally outputs the filled area as horizontal spans via `out_spans`.
  *
- * @param renderer     SDL renderer (target canvas).
+ * @param canvas       Canvas to fill.
  * @param start_x      X coordinate to start filling.
  * @param start_y      Y coordinate to start filling.
- * @param target_color Color to be replaced.
  * @param fill_color   Fill color to apply.
- * @param out_points   Optional output: pointer to an array of filled points (can be NULL).
- * @return             Number of pixels filled, or -1 on error.
+ * @param out_spans    Optional output: pointer to an array of filled spans (can be NULL).
+ * @return             Number of spans filled, or -1 on error.
  */
-int flood_fill(SDL_Renderer *renderer, int start_x, int start_y,
-               SDL_Color target_color, SDL_Color fill_color, Point **out_points);
+int flood_fill(Canvas *canvas, int start_x, int start_y,
+               SDL_Color fill_color, Span **out_spans);
 
 /**
  * Returns a human-readable name string for the given tool.
@@ -103,15 +152,16 @@ int flood_fill(SDL_Renderer *renderer, int start_x, int start_y,
 const char* get_tool_name(const Tool *tool);
 
 /**
- * Renders text at the specified position using the given font and color.
+ * Renders text into the canvas at the specified position using the given font and color.
+ * Glyphs come from the face's atlas and are only rasterized the first time they are used.
  *
- * @param renderer SDL renderer to use for drawing.
- * @param font     TTF font to use for text rendering.
+ * @param canvas   Canvas to draw into.
+ * @param face     Cached font face (see get_font_face).
  * @param text     Text string to render.
  * @param x        X position to render the text.
  * @param y        Y position to render the text.
  * @param color    Color to use for the text.
  */
-void render_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color color);
+void render_text(Canvas *canvas, FontFace *face, const char *text, int x, int y, SDL_Color color);
 
 #endif // TOOLS_H
@@ -1,26 +1,363 @@
 #include "app.h"
 #include "context/logs.h"
 #include "context/paint_context.h"
+#include "context/document.h"
+#include "context/profile.h"
 #include "tools/tools.h"
 #include "sidebar.h"
+#include "input_record.h"
 #include "assets.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 Assets *global_assets = NULL;
 
-int run_app(const char *target_file_path, Config* config) {
+// Glyph atlas of the preview font as a renderer texture. It is uploaded again
+// only when the face changes or new glyphs were rasterized into it.
+typedef struct {
+    FontFace *face;
+    Uint32 version;
+    int height;
+    SDL_Texture *texture;
+} PreviewAtlas;
+
+static PreviewAtlas preview_atlas = {0};
+
+static SDL_Texture *update_preview_atlas(SDL_Renderer *renderer, FontFace *face) {
+    PreviewAtlas *atlas = &preview_atlas;
+    if (!face->atlas)
+        return NULL;
+    if (atlas->texture && atlas->face == face && atlas->version == face->atlas_version)
+        return atlas->texture;
+
+    if (!atlas->texture || atlas->height != face->atlas_height) {
+        if (atlas->texture)
+            SDL_DestroyTexture(atlas->texture);
+        atlas->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                           GLYPH_ATLAS_WIDTH, face->atlas_height);
+        if (!atlas->texture) {
+            log_error("Failed to create glyph atlas texture: %s", SDL_GetError());
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+        atlas->height = face->atlas_height;
+    }
+
+    // White glyphs with coverage as alpha, tinted by the texture color mod
+    size_t count = (size_t)GLYPH_ATLAS_WIDTH * face->atlas_height;
+    Uint32 *pixels = malloc(count * sizeof(Uint32));
+    if (!pixels)
+        return NULL;
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = ((Uint32)face->atlas[i] << 24) | 0xFFFFFF;
+    }
+    SDL_UpdateTexture(atlas->texture, NULL, pixels, GLYPH_ATLAS_WIDTH * sizeof(Uint32));
+    free(pixels);
+
+    atlas->face = face;
+    atlas->version = face->atlas_version;
+    return atlas->texture;
+}
+
+// Draws the uncommitted text preview straight to the renderer, on top of the canvas.
+static void render_preview_text(SDL_Renderer *renderer, FontFace *face, const char *text,
+                                int x, int y, SDL_Color color) {
+    // Rasterize any new glyphs first so the atlas is uploaded at most once.
+    measure_text(face, text, NULL, NULL);
+    SDL_Texture *texture = update_preview_atlas(renderer, face);
+    if (!texture)
+        return;
+    SDL_SetTextureColorMod(texture, color.r, color.g, color.b);
+    SDL_SetTextureAlphaMod(texture, color.a);
+
+    int pen_x = x;
+    Uint16 previous = 0;
+    Uint16 codepoint;
+    while ((codepoint = next_codepoint(&text)) != 0) {
+        const Glyph *glyph = get_glyph(face, codepoint);
+        if (!glyph)
+            continue;
+
+        pen_x += glyph_kerning(face, previous, codepoint);
+        if (glyph->w > 0) {
+            SDL_Rect src = {glyph->x, glyph->y, glyph->w, glyph->h};
+            SDL_Rect dst = {pen_x + glyph->offset_x, y, glyph->w, glyph->h};
+            SDL_RenderCopy(renderer, texture, &src, &dst);
+        }
+        pen_x += glyph->advance;
+        previous = codepoint;
+    }
+}
+
+// Area covered by the text preview box and its cursor.
+static SDL_Rect text_preview_bounds(PaintContext *context, FontFace *preview_face) {
+    int text_w = 0, text_h = 16;
+    if (preview_face)
+        measure_text(preview_face, context->text_input_buffer, &text_w, &text_h);
+
+    SDL_Rect bounds = {
+        context->text_input_x - 2,
+        context->text_input_y - 2,
+        text_w + 5,
+        text_h + 4
+    };
+    return bounds;
+}
+
+static void draw_text_preview(SDL_Renderer *renderer, PaintContext *context, FontFace *preview_face) {
+    int text_w = 0;
+    int text_h = 16;
+    if (preview_face)
+        measure_text(preview_face, context->text_input_buffer, &text_w, &text_h);
+
+    if (preview_face && strlen(context->text_input_buffer) > 0) {
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 128);
+        
+        SDL_Rect bg_rect = {
+            context->text_input_x - 2,
+            context->text_input_y - 2,
+            text_w + 4,
+            text_h + 4
+        };
+        SDL_RenderFillRect(renderer, &bg_rect);
+        
+        render_preview_text(renderer, preview_face, context->text_input_buffer, 
+                   context->text_input_x, context->text_input_y, context->current_tool.color);
+    }
+    
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderDrawLine(renderer, 
+                      context->text_input_x + text_w, context->text_input_y,
+                      context->text_input_x + text_w, context->text_input_y + text_h);
+}
+
+// Frame time percentiles drawn over the bottom-right corner of the window,
+// toggled with F3. Only builds with MOBPAINT_PROFILE measure frames.
+typedef struct {
+    bool visible;
+    char text[96];
+    SDL_Rect bounds;    // Where the overlay was last drawn
+} FrameOverlay;
+
+static FrameOverlay frame_overlay = {0};
+
+// Refreshes the overlay text from the latest frames and moves its bounds.
+static void update_frame_overlay(FrameOverlay *overlay, TTF_Font *font, Config *config) {
+    FrameStats stats;
+    int w = 0, h = 0;
+    if (overlay->visible && font && profile_frame_stats(&stats)) {
+        snprintf(overlay->text, sizeof(overlay->text),
+                 "frame p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms (%d)",
+                 stats.p50, stats.p95, stats.p99, stats.max, stats.frames);
+        TTF_SizeText(font, overlay->text, &w, &h);
+    }
+    overlay->bounds = (SDL_Rect){config->window_width - w - 12, config->window_height - h - 8, w + 8, h + 4};
+    if (w == 0)
+        overlay->bounds = (SDL_Rect){0, 0, 0, 0};
+}
+
+static void draw_frame_overlay(SDL_Renderer *renderer, const FrameOverlay *overlay, TTF_Font *font) {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 192);
+    SDL_RenderFillRect(renderer, &overlay->bounds);
+
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface *surface = TTF_RenderText_Blended(font, overlay->text, white);
+    if (!surface)
+        return;
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_Rect text_rect = {overlay->bounds.x + 4, overlay->bounds.y + 2, surface->w, surface->h};
+    SDL_RenderCopy(renderer, texture, NULL, &text_rect);
+    SDL_FreeSurface(surface);
+    SDL_DestroyTexture(texture);
+}
+
+// Writes the recorded probes as a Chrome trace into the log directory (F12).
+static void dump_trace(Config *config) {
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+
+    char path[LOG_DIR_MAX_LEN + 64];
+    snprintf(path, sizeof(path), "%s/trace-%s.json", config->log_dir, stamp);
+    if (profile_dump_trace(path))
+        log_info("Wrote frame trace to %s.", path);
+}
+
+// Marks the topbar and sidebar for redrawing after the cached chrome changed.
+static void invalidate_chrome(DirtyRegion *damage, Config *config) {
+    SDL_Rect topbar = {0, 0, config->window_width, TOPBAR_HEIGHT};
+    SDL_Rect sidebar = {0, 0, SIDEBAR_WIDTH, config->window_height};
+    dirty_region_add(damage, &topbar);
+    dirty_region_add(damage, &sidebar);
+}
+
+// Paces presents to the target frame rate. Between frames the main loop
+// blocks in SDL_WaitEvent(Timeout), so an idle window uses no CPU.
+typedef struct {
+    Uint64 frequency;       // Performance counter ticks per second
+    Uint64 frame_ticks;     // Counter ticks per frame
+    Uint64 next_present;    // Earliest counter value for the next present
+} FramePacer;
+
+static void init_frame_pacer(FramePacer *pacer, SDL_Window *window, int target_fps) {
+    int fps = target_fps;
+    if (fps <= 0) {
+        SDL_DisplayMode mode;
+        int display = SDL_GetWindowDisplayIndex(window);
+        if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0)
+            fps = mode.refresh_rate;
+        else
+            fps = 60;
+    }
+
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->frame_ticks = pacer->frequency / fps;
+    pacer->next_present = 0;
+    log_info("Presenting at up to %d frames per second.", fps);
+}
+
+// Milliseconds the event wait may block: forever when there is nothing to
+// present, otherwise until the next frame is due (rounded up).
+static int frame_wait_timeout(const FramePacer *pacer, bool needs_redraw) {
+    if (!needs_redraw)
+        return -1;
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now >= pacer->next_present)
+        return 0;
+    return (int)(((pacer->next_present - now) * 1000 + pacer->frequency - 1) / pacer->frequency);
+}
+
+// Returns true and books the following frame if a present is allowed now.
+// Frames keep a steady cadence, but a stall is not caught up with a burst.
+static bool frame_due(FramePacer *pacer) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now < pacer->next_present)
+        return false;
+
+    pacer->next_present += pacer->frame_ticks;
+    if (pacer->next_present <= now)
+        pacer->next_present = now + pacer->frame_ticks;
+    return true;
+}
+
+// Brush and eraser samples gathered while the event queue is drained. They
+// are drawn as one joined path instead of one segment per motion event.
+#define MOTION_BATCH_MAX 256
+
+typedef struct {
+    Point points[MOTION_BATCH_MAX];
+    int count;
+} MotionBatch;
+
+// Draws and records the pending samples. Returns true if there were any.
+static bool flush_motion(PaintContext *context, MotionBatch *batch) {
+    if (batch->count == 0)
+        return false;
+
+    extend_stroke(context, batch->points, batch->count);
+    batch->count = 0;
+    return true;
+}
+
+// Recomposites only the damaged parts of the window (canvas, then chrome,
+// then the text preview) and pushes just those rectangles to the screen.
+static void render_frame(SDL_Window *window, SDL_Renderer *renderer, PaintContext *context,
+                         Config *config, ChromeCache *chrome, FontFace *preview_face,
+                         const SDL_Rect *preview, DirtyRegion *damage) {
+    PROFILE_SCOPE("render_frame");
+    dirty_region_merge(damage, &context->canvas->dirty);
+    dirty_region_clear(&context->canvas->dirty);
+
+    // The UI font is opened from the embedded pack the first time it is needed
+    FontFace *ui_face = get_font_face(UI_FONT_SIZE);
+    TTF_Font *font = ui_face ? ui_face->font : NULL;
+
+    // The chrome is only re-rendered, and presented, when what it shows changed.
+    {
+        PROFILE_SCOPE("update_chrome");
+        if (update_chrome_cache(chrome, renderer, context, config, font))
+            invalidate_chrome(damage, config);
+    }
+
+    // The overlay changes every frame it is shown
+    if (frame_overlay.visible) {
+        dirty_region_add(damage, &frame_overlay.bounds);
+        update_frame_overlay(&frame_overlay, font, config);
+        dirty_region_add(damage, &frame_overlay.bounds);
+    }
+
+    SDL_Surface *surface = SDL_GetWindowSurface(window);
+    if (!surface || dirty_region_is_empty(damage))
+        return;
+
+    SDL_Rect topbar = {0, 0, config->window_width, TOPBAR_HEIGHT};
+    SDL_Rect sidebar = {0, 0, SIDEBAR_WIDTH, config->window_height};
+
+    for (int i = 0; i < damage->count; i++) {
+        const SDL_Rect *rect = &damage->rects[i];
+        {
+            PROFILE_SCOPE("composite_canvas");
+            canvas_copy_to_surface(context->canvas, rect, surface);
+        }
+
+        PROFILE_SCOPE("draw_chrome");
+        SDL_RenderSetClipRect(renderer, rect);
+        if (SDL_HasIntersection(rect, &topbar) || SDL_HasIntersection(rect, &sidebar))
+            draw_chrome(chrome, renderer, context, config, font);
+        if (context->text_input_active && SDL_HasIntersection(rect, preview))
+            draw_text_preview(renderer, context, preview_face);
+        if (frame_overlay.visible && font && SDL_HasIntersection(rect, &frame_overlay.bounds))
+            draw_frame_overlay(renderer, &frame_overlay, font);
+    }
+    SDL_RenderSetClipRect(renderer, NULL);
+
+    PROFILE_SCOPE("present");
+    SDL_UpdateWindowSurfaceRects(window, damage->rects, damage->count);
+    dirty_region_clear(damage);
+}
+
+// While a recording is replayed the user's input is ignored; only closing
+// the window and repaints are handled. Returns false once the window closed.
+static bool pump_window_events(DirtyRegion *damage, const SDL_Rect *whole_window) {
+    SDL_Event event;
+    bool open = true;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT)
+            open = false;
+        else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED)
+            dirty_region_add(damage, whole_window);
+    }
+    return open;
+}
+
+// Milliseconds elapsed since `start`, a performance counter value
+static double elapsed_ms(Uint64 start) {
+    return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+int run_app(const char *target_file_path, Config* config, Uint64 start, const InputOptions *input) {
     log_info("Running app with target file: %s", target_file_path);
+    profile_thread_name("main");
+    double config_ms = elapsed_ms(start);
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         log_error("SDL_Init Error: %s", SDL_GetError());
         return 1;
     }
 
+    // An existing document decides the canvas size
     int window_width = config->window_width;
     int window_height = config->window_height;
+    if (document_peek_size(target_file_path, &window_width, &window_height)) {
+        config->window_width = window_width;
+        config->window_height = window_height;
+    }
 
     SDL_Window *window = SDL_CreateWindow("MobPaint",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -32,7 +369,10 @@ int run_app(const char *target_file_path, Config* config) {
         return 1;
     }
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    // Draw straight into the window surface so damaged rectangles can be
+    // pushed with SDL_UpdateWindowSurfaceRects instead of a full present.
+    SDL_Surface *window_surface = SDL_GetWindowSurface(window);
+    SDL_Renderer *renderer = window_surface ? SDL_CreateSoftwareRenderer(window_surface) : NULL;
     if (!renderer) {
         log_error("SDL_CreateRenderer Error: %s", SDL_GetError());
         SDL_DestroyWindow(window);
@@ -45,34 +385,78 @@ int run_app(const char *target_file_path, Config* config) {
         return 1;
     }
 
-    TTF_Font *font = TTF_OpenFont("assets/OpenSans.ttf", 16);
-    if (!font) {
-        log_error("Font load error: %s\n", TTF_GetError());
-        return 1;
-    }
-
-    SDL_Color background_color = config->default_background_color;
-
-    SDL_SetRenderDrawColor(renderer, background_color.r, background_color.g,
-                                      background_color.b, background_color.a);
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
     SDL_ShowWindow(window);
+    double window_ms = elapsed_ms(start);
 
+    // Icons and fonts are compiled in and only uploaded or opened when first drawn
     global_assets = load_assets(renderer);
-    
+
     PaintContext context;
     Tool current_tool;
     init_tool(&current_tool, config);
     init_paint_context(renderer, &context, config, current_tool);
 
+    // A replay has to leave the document as it found it
+    Document document;
+    if (input->replay_path)
+        open_document_read_only(&document, target_file_path, &context);
+    else
+        open_document(&document, target_file_path, &context, config);
+    double document_ms = elapsed_ms(start);
+
+    ChromeCache chrome;
+    init_chrome_cache(&chrome, renderer, config);
+
     bool running = true;
     bool drawing = false;
     bool needs_redraw = true;
+    bool first_frame = true;
+    int result = 0;
+    SDL_Rect preview_bounds = {0, 0, 0, 0};
+    DirtyRegion damage;
     SDL_Event event;
 
+    dirty_region_clear(&damage);
+    SDL_Rect whole_window = {0, 0, window_width, window_height};
+    dirty_region_add(&damage, &whole_window);
+
+    MotionBatch motion = {.count = 0};
+    FramePacer pacer;
+    init_frame_pacer(&pacer, window, config->target_fps);
+
+    InputRecorder recorder;
+    InputReplay replay;
+    bool recording = input->record_path && open_input_recording(&recorder, input->record_path, context.canvas);
+    bool replaying = input->replay_path &&
+                     open_input_replay(&replay, input->replay_path, context.canvas, input->replay_realtime);
+    if (input->replay_path && !replaying) {
+        running = false;
+        result = 1;
+    }
+
     while (running) {
-        while (SDL_PollEvent(&event)) {
+        Uint64 frame_start = SDL_GetPerformanceCounter();
+        int has_event;
+        if (replaying) {
+            // The recording supplies the input up to its next frame
+            running = pump_window_events(&damage, &whole_window);
+            has_event = next_input_event(&replay, &event);
+        } else {
+            // Sleep until input arrives or the next frame is due, then drain the
+            // whole queue so each present reflects all pending input.
+            int timeout = frame_wait_timeout(&pacer, needs_redraw);
+            has_event = timeout < 0 ? SDL_WaitEvent(&event) : SDL_WaitEventTimeout(&event, timeout);
+        }
+        profile_begin_frame();
+        for (; has_event; has_event = replaying ? next_input_event(&replay, &event) : SDL_PollEvent(&event)) {
+            PROFILE_SCOPE("handle_event");
+            if (recording)
+                record_input_event(&recorder, &event);
+
+            // Anything but motion may depend on the samples before it.
+            if (event.type != SDL_MOUSEMOTION && flush_motion(&context, &motion))
+                needs_redraw = true;
+
             switch (event.type) {
                 case SDL_QUIT:
                     log_info("Window close event received.");
@@ -114,7 +498,8 @@ int run_app(const char *target_file_path, Config* config) {
                         drawing = false;
                         int prev_x = -1, prev_y = -1;
 
-                        if (context.current_tool.type == TOOL_LINE || context.current_tool.type == TOOL_CIRCLE) {
+                        if ((context.current_tool.type == TOOL_LINE || context.current_tool.type == TOOL_CIRCLE) &&
+                            context.current_stroke && context.current_stroke->count > 0) {
                             prev_x = context.current_stroke->points[0].x;
                             prev_y = context.current_stroke->points[0].y;
 
@@ -123,11 +508,8 @@ int run_app(const char *target_file_path, Config* config) {
 
                             use_tool(&context, prev_x, prev_y);
                         } else if (context.current_tool.type != TOOL_FILL && context.current_tool.type != TOOL_TEXT) {
-                            prev_x = context.mouse_x;
-                            prev_y = context.mouse_y;
-                            context.mouse_x = event.button.x;
-                            context.mouse_y = event.button.y;
-                            use_tool(&context, prev_x, prev_y);
+                            Point release = {event.button.x, event.button.y};
+                            extend_stroke(&context, &release, 1);
                         }
 
                         context.mouse_x = -1;
@@ -144,14 +526,13 @@ int run_app(const char *target_file_path, Config* config) {
 
                 case SDL_MOUSEMOTION:
                     if (drawing && (event.motion.state & SDL_BUTTON_LMASK)) {
-                        int prev_x = context.mouse_x;
-                        int prev_y = context.mouse_y;
                         context.mouse_x = event.motion.x;
                         context.mouse_y = event.motion.y;
 
-                        if (context.current_tool.type != TOOL_LINE && context.current_tool.type != TOOL_CIRCLE 
-                                    && context.current_tool.type != TOOL_FILL && context.current_tool.type != TOOL_TEXT) {
-                            use_tool(&context, prev_x, prev_y);
+                        if (context.current_tool.type == TOOL_BRUSH || context.current_tool.type == TOOL_ERASER) {
+                            if (motion.count == MOTION_BATCH_MAX)
+                                flush_motion(&context, &motion);
+                            motion.points[motion.count++] = (Point){event.motion.x, event.motion.y};
                             needs_redraw = true;
                         }
                     }
@@ -162,7 +543,6 @@ int run_app(const char *target_file_path, Config* config) {
                         if (!handle_text_key(&context, event.key.keysym.sym)) {
                             finalize_text_input(&context);
                             end_stroke(&context);
-                            redraw_canvas(&context);
                         } 
                         needs_redraw = true;
                     } else {
@@ -170,12 +550,12 @@ int run_app(const char *target_file_path, Config* config) {
                             log_info("ESC pressed. Exiting.");
                             running = false;
                         } else if (event.key.keysym.sym == SDLK_c && (event.key.keysym.mod & KMOD_CTRL)) {
-                            SDL_SetRenderDrawColor(renderer, background_color.r, background_color.g,
-                                                              background_color.b, background_color.a);
-                            SDL_RenderClear(renderer);
-                            SDL_RenderCopy(renderer, context.bitmap_cache, NULL, NULL);
+                            if (clear_canvas(&context))
+                                log_info("Canvas cleared.");
                             needs_redraw = true;
-                            log_info("Canvas cleared.");
+                        } else if (event.key.keysym.sym == SDLK_s && (event.key.keysym.mod & KMOD_CTRL)) {
+                            if (save_document(&document, &context))
+                                log_info("Saving %s.", target_file_path);
                         } else if (event.key.keysym.sym == SDLK_z && (event.key.keysym.mod & KMOD_CTRL)) {
                             bool changed = false;
                             if (event.key.keysym.mod & KMOD_SHIFT) {
@@ -184,7 +564,6 @@ int run_app(const char *target_file_path, Config* config) {
                                 changed = paint_context_undo(&context);
                             }
                             if (changed) {
-                                redraw_canvas(&context);
                                 needs_redraw = true;
                             }
                         } else if (event.key.keysym.sym == SDLK_i && (event.key.keysym.mod & KMOD_CTRL)) {
@@ -195,6 +574,12 @@ int run_app(const char *target_file_path, Config* config) {
                             if (context.current_tool.size > 1)
                                 --context.current_tool.size;
                             needs_redraw = true;
+                        } else if (event.key.keysym.sym == SDLK_F3) {
+                            frame_overlay.visible = !frame_overlay.visible;
+                            dirty_region_add(&damage, &frame_overlay.bounds);
+                            needs_redraw = true;
+                        } else if (event.key.keysym.sym == SDLK_F12) {
+                            dump_trace(config);
                         } else if (event.key.keysym.sym >= SDLK_1 && event.key.keysym.sym < SDLK_1 + TOOL_COUNT) {
                             ToolType tool_type = event.key.keysym.sym - SDLK_1;
                             set_tool_type(&context.current_tool, tool_type);
@@ -204,6 +589,13 @@ int run_app(const char *target_file_path, Config* config) {
                     }
                     break;
 
+                case SDL_WINDOWEVENT:
+                    if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                        dirty_region_add(&damage, &whole_window);
+                        needs_redraw = true;
+                    }
+                    break;
+
                 case SDL_TEXTINPUT:
                     if (context.text_input_active) {
                         handle_text_input(&context, event.text.text);
@@ -216,68 +608,64 @@ int run_app(const char *target_file_path, Config* config) {
             }
         }
 
-        if (needs_redraw) {
-            if (context.text_input_active) {
-                redraw_canvas(&context);
-            }
-            
-            draw_topbar(renderer, &context, config, font);
-            draw_left_sidebar(renderer, &context, config);
-            
-            if (context.text_input_active) {
-                TTF_Font *preview_font = TTF_OpenFont("assets/OpenSans.ttf", context.current_tool.size + 12);
-                if (preview_font && strlen(context.text_input_buffer) > 0) {
-                    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 128);
-                    
-                    int text_w, text_h;
-                    TTF_SizeText(preview_font, context.text_input_buffer, &text_w, &text_h);
-                    
-                    SDL_Rect bg_rect = {
-                        context.text_input_x - 2,
-                        context.text_input_y - 2,
-                        text_w + 4,
-                        text_h + 4
-                    };
-                    SDL_RenderFillRect(renderer, &bg_rect);
-                    
-                    render_text(renderer, preview_font, context.text_input_buffer, 
-                               context.text_input_x, context.text_input_y, context.current_tool.color);
-                }
-                
-                int text_w = 0;
-                if (preview_font && strlen(context.text_input_buffer) > 0) {
-                    TTF_SizeText(preview_font, context.text_input_buffer, &text_w, NULL);
-                }
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-                int cursor_height;
-                if (preview_font) {
-                    TTF_SizeText(preview_font, "I", NULL, &cursor_height);
-                } else {
-                    cursor_height = 16;
-                }
-                if (preview_font) {
-                    TTF_CloseFont(preview_font);
-                }
-                SDL_RenderDrawLine(renderer, 
-                                  context.text_input_x + text_w, context.text_input_y,
-                                  context.text_input_x + text_w, context.text_input_y + cursor_height);
-            }
-            
-            SDL_RenderPresent(renderer);
+        autosave_document(&document, &context);
+
+        // Samples keep accumulating until a frame is due, then go in one batch.
+        // A replay presents exactly where the recorded session did.
+        bool present = replaying ? replay.frame : needs_redraw && frame_due(&pacer);
+        if (present) {
+            flush_motion(&context, &motion);
+
+            FontFace *preview_face = context.text_input_active
+                                   ? get_font_face(context.current_tool.size + 12) : NULL;
+
+            // The preview is not part of the canvas: repaint where it was and where it is now.
+            dirty_region_add(&damage, &preview_bounds);
+            preview_bounds = context.text_input_active ? text_preview_bounds(&context, preview_face)
+                                                       : (SDL_Rect){0, 0, 0, 0};
+            dirty_region_add(&damage, &preview_bounds);
+
+            render_frame(window, renderer, &context, config, &chrome, preview_face, &preview_bounds, &damage);
             needs_redraw = false;
-        }
+            profile_end_frame();
+            if (recording)
+                record_input_frame(&recorder);
+            if (replaying)
+                input_replay_frame_done(&replay, elapsed_ms(frame_start));
 
-        SDL_Delay(1);
+            if (first_frame) {
+                log_info("First frame after %.1f ms (config %.1f ms, window %.1f ms, document %.1f ms)",
+                         elapsed_ms(start), config_ms, window_ms, document_ms);
+                first_frame = false;
+            }
+        }
+        if (replaying && replay.finished)
+            running = false;
     }
 
+    // Keep the session: finish any open stroke and save before tearing down.
+    // Loaded history lives in the document's mapping, so it closes last.
+    flush_motion(&context, &motion);
+    if (context.current_stroke)
+        end_stroke(&context);
+    if (recording)
+        close_input_recording(&recorder, context.canvas);
+    if (replaying && !close_input_replay(&replay, context.canvas))
+        result = 1;
+    save_document(&document, &context);
+    wait_for_saves(&document, &context);
     free_paint_context(&context);
+    close_document(&document);
+    free_chrome_cache(&chrome);
     free_assets(global_assets);
-    TTF_CloseFont(font);
+    if (preview_atlas.texture)
+        SDL_DestroyTexture(preview_atlas.texture);
+    free_font_cache();
     TTF_Quit();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
     log_info("App exited cleanly.");
-    return 0;
+    return result;
 }
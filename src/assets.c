@@ -1,49 +1,56 @@
 #include "assets.h"
-#include <SDL2/SDL_image.h>
 #include <stdlib.h>
-#include <string.h>
-
-static SDL_Texture *load_texture(SDL_Renderer *renderer, const char *path) {
-    SDL_Surface *surf = IMG_Load(path);
-    if (!surf) return NULL;
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(renderer, surf);
-    SDL_FreeSurface(surf);
-    return tex;
-}
+#include "asset_pack.h"
+#include "context/logs.h"
+
+static const AssetImage *const icon_images[ICON_COUNT] = {
+    [ICON_BRUSH]  = &asset_brush,
+    [ICON_ERASER] = &asset_eraser,
+    [ICON_LINE]   = &asset_line,
+    [ICON_CIRCLE] = &asset_circle,
+    [ICON_FILL]   = &asset_fill,
+    [ICON_TEXT]   = &asset_text,
+    [ICON_UNDO]   = &asset_undo,
+    [ICON_REDO]   = &asset_redo,
+    [ICON_PLUS]   = &asset_plus,
+    [ICON_MINUS]  = &asset_minus,
+};
 
 Assets *load_assets(SDL_Renderer *renderer) {
-    Assets *assets = malloc(sizeof(Assets));
-    memset(assets, 0, sizeof(Assets));
-
-    const char *tool_paths[] = {
-        "assets/brush.png",
-        "assets/eraser.png",
-        "assets/line.png",
-        "assets/circle.png",
-        "assets/fill.png",
-        "assets/text.png"
-    };
+    Assets *assets = calloc(1, sizeof(Assets));
+    if (!assets)
+        return NULL;
+    assets->renderer = renderer;
+    return assets;
+}
 
-    for (int i = 0; i < 6; i++) {
-        assets->tool_icons[i] = load_texture(renderer, tool_paths[i]);
+SDL_Texture *get_icon(Assets *assets, AssetIcon icon) {
+    if (!assets || (unsigned)icon >= ICON_COUNT)
+        return NULL;
+    if (assets->icons[icon])
+        return assets->icons[icon];
+
+    // The pack holds decoded pixels, so this is a plain upload
+    const AssetImage *image = icon_images[icon];
+    SDL_Texture *texture = SDL_CreateTexture(assets->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                             SDL_TEXTUREACCESS_STATIC, image->width, image->height);
+    if (!texture) {
+        log_error("Failed to create icon texture: %s", SDL_GetError());
+        return NULL;
     }
+    SDL_UpdateTexture(texture, NULL, image->pixels, image->width * (int)sizeof(Uint32));
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
 
-    assets->undo  = load_texture(renderer, "assets/undo.png");
-    assets->redo  = load_texture(renderer, "assets/redo.png");
-    assets->plus  = load_texture(renderer, "assets/plus.png");
-    assets->minus = load_texture(renderer, "assets/minus.png");
-
-    return assets;
+    assets->icons[icon] = texture;
+    return texture;
 }
 
 void free_assets(Assets *assets) {
-    for (int i = 0; i < 6; i++) {
-        if (assets->tool_icons[i]) SDL_DestroyTexture(assets->tool_icons[i]);
+    if (!assets)
+        return;
+    for (int i = 0; i < ICON_COUNT; i++) {
+        if (assets->icons[i])
+            SDL_DestroyTexture(assets->icons[i]);
     }
-
-    SDL_DestroyTexture(assets->undo);
-    SDL_DestroyTexture(assets->redo);
-    SDL_DestroyTexture(assets->plus);
-    SDL_DestroyTexture(assets->minus);
     free(assets);
 }
@@ -0,0 +1,511 @@
+#include "canvas/canvas.h"
+#include <stdlib.h>
+#include <string.h>
+#include "canvas/pixel_ops.h"
+
+#define TS CANVAS_TILE_SIZE
+
+// Clips a rectangle to the given bounds. Returns false if nothing is left.
+static bool clip_rect(const SDL_Rect *rect, const SDL_Rect *bounds, SDL_Rect *out) {
+    int x1 = SDL_max(rect->x, bounds->x);
+    int y1 = SDL_max(rect->y, bounds->y);
+    int x2 = SDL_min(rect->x + rect->w, bounds->x + bounds->w);
+    int y2 = SDL_min(rect->y + rect->h, bounds->y + bounds->h);
+    if (x2 <= x1 || y2 <= y1)
+        return false;
+    *out = (SDL_Rect){x1, y1, x2 - x1, y2 - y1};
+    return true;
+}
+
+static inline void mark_dirty(Canvas *canvas, int x, int y, int w, int h) {
+    SDL_Rect rect = {x, y, w, h};
+    dirty_region_add(&canvas->dirty, &rect);
+}
+
+static inline int tile_index(const Canvas *canvas, int x, int y) {
+    return (y / TS) * canvas->tiles_x + x / TS;
+}
+
+static void mark_tile_dirty(Canvas *canvas, int index) {
+    SDL_Rect rect = {(index % canvas->tiles_x) * TS, (index / canvas->tiles_x) * TS, TS, TS};
+    canvas_invalidate(canvas, &rect);
+}
+
+// Captures the tile for the active recording the first time it is touched.
+// Returns false if it could not be captured; the tile must not be changed
+// then, or undo would leave the change behind.
+static bool record_tile(Canvas *canvas, int index) {
+    if (!canvas->recording || canvas->record_stamp[index] == canvas->record_generation)
+        return true;
+    if (!tile_delta_record(canvas->recording, index, canvas->tiles[index]))
+        return false;
+    canvas->record_stamp[index] = canvas->record_generation;
+    return true;
+}
+
+// Returns a tile that may be written, copying it first if it is shared
+// with the history or with other tile slots. NULL drops the write.
+static CanvasTile *writable_tile(Canvas *canvas, int index) {
+    if (!record_tile(canvas, index))
+        return NULL;
+
+    CanvasTile *tile = canvas->tiles[index];
+    if (is_tile_shared(tile)) {
+        CanvasTile *copy = clone_tile(tile);
+        if (!copy)
+            return NULL;
+        canvas->tiles[index] = copy;
+        release_tile(tile);
+        tile = copy;
+    }
+    return tile;
+}
+
+// Pointer to pixel (x, y) for writing; *run receives the number of pixels
+// left in the same tile row, starting at x.
+static Uint32 *write_ptr(Canvas *canvas, int x, int y, int *run) {
+    CanvasTile *tile = writable_tile(canvas, tile_index(canvas, x, y));
+    *run = TS - x % TS;
+    if (!tile)
+        return NULL;
+    return &tile->pixels[(y % TS) * TS + x % TS];
+}
+
+static const Uint32 *read_ptr(const Canvas *canvas, int x, int y, int *run) {
+    const CanvasTile *tile = canvas->tiles[tile_index(canvas, x, y)];
+    *run = TS - x % TS;
+    return &tile->pixels[(y % TS) * TS + x % TS];
+}
+
+// Paints [x1, x2] on row y, already clipped, without marking damage.
+// Opaque colors overwrite, translucent ones are composited source-over.
+static void fill_row(Canvas *canvas, int x1, int x2, int y, Uint32 color) {
+    const Uint32 alpha = color >> 24;
+    if (alpha == 0)
+        return;
+
+    int x = x1;
+    while (x <= x2) {
+        int run;
+        Uint32 *dst = write_ptr(canvas, x, y, &run);
+        if (run > x2 - x + 1)
+            run = x2 - x + 1;
+        if (dst) {
+            if (alpha == 255)
+                pixels_fill(dst, run, color);
+            else
+                pixels_blend_color(dst, run, color);
+        }
+        x += run;
+    }
+}
+
+Canvas *create_canvas(int width, int height) {
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    Canvas *canvas = malloc(sizeof(Canvas));
+    if (!canvas)
+        return NULL;
+
+    canvas->width = width;
+    canvas->height = height;
+    canvas->tiles_x = (width + TS - 1) / TS;
+    canvas->tiles_y = (height + TS - 1) / TS;
+    canvas->recording = NULL;
+    canvas->record_generation = 0;
+    canvas->coverage = NULL;
+    canvas->coverage_stride = (width + 63) / 64;
+    canvas->covering = false;
+    canvas->covered_top = height;
+    canvas->covered_bottom = -1;
+    canvas->clip = (SDL_Rect){0, 0, width, height};
+
+    int tile_count = canvas->tiles_x * canvas->tiles_y;
+    canvas->tiles = calloc(tile_count, sizeof(CanvasTile *));
+    canvas->record_stamp = calloc(tile_count, sizeof(Uint32));
+    if (!canvas->tiles || !canvas->record_stamp) {
+        free(canvas->tiles);
+        free(canvas->record_stamp);
+        free(canvas);
+        return NULL;
+    }
+
+    dirty_region_clear(&canvas->dirty);
+    canvas_clear(canvas, 0);
+    if (!canvas->tiles[0]) {
+        free_canvas(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+void free_canvas(Canvas *canvas) {
+    if (!canvas)
+        return;
+    for (int i = 0; i < canvas->tiles_x * canvas->tiles_y; i++) {
+        release_tile(canvas->tiles[i]);
+    }
+    free(canvas->tiles);
+    free(canvas->record_stamp);
+    free(canvas->coverage);
+    free(canvas);
+}
+
+Uint32 canvas_map_color(SDL_Color color) {
+    return premultiply_pixel(((Uint32)color.a << 24) | ((Uint32)color.r << 16) |
+                             ((Uint32)color.g << 8) | (Uint32)color.b);
+}
+
+SDL_Color canvas_unmap_color(Uint32 pixel) {
+    pixel = unpremultiply_pixel(pixel);
+    SDL_Color color = {
+        .r = (Uint8)(pixel >> 16),
+        .g = (Uint8)(pixel >> 8),
+        .b = (Uint8)pixel,
+        .a = (Uint8)(pixel >> 24)
+    };
+    return color;
+}
+
+void canvas_clear(Canvas *canvas, Uint32 color) {
+    if (!canvas)
+        return;
+
+    CanvasTile *solid = create_tile(color);
+    if (!solid)
+        return;
+
+    for (int i = 0; i < canvas->tiles_x * canvas->tiles_y; i++) {
+        if (canvas->tiles[i] && !record_tile(canvas, i))
+            continue;
+        release_tile(canvas->tiles[i]);
+        canvas->tiles[i] = retain_tile(solid);
+    }
+    release_tile(solid);
+    mark_dirty(canvas, 0, 0, canvas->width, canvas->height);
+}
+
+bool canvas_copy(Canvas *dst, const Canvas *src) {
+    if (!dst || !src || dst->width != src->width || dst->height != src->height)
+        return false;
+
+    for (int i = 0; i < dst->tiles_x * dst->tiles_y; i++) {
+        if (dst->tiles[i] == src->tiles[i])
+            continue;
+        if (!record_tile(dst, i))
+            continue;
+        release_tile(dst->tiles[i]);
+        dst->tiles[i] = retain_tile(src->tiles[i]);
+        mark_tile_dirty(dst, i);
+    }
+    return true;
+}
+
+Uint32 canvas_get_pixel(const Canvas *canvas, int x, int y) {
+    if (x < 0 || y < 0 || x >= canvas->width || y >= canvas->height)
+        return 0;
+    int run;
+    return *read_ptr(canvas, x, y, &run);
+}
+
+void canvas_set_pixel(Canvas *canvas, int x, int y, Uint32 color) {
+    const SDL_Rect *clip = &canvas->clip;
+    if (x < clip->x || y < clip->y || x >= clip->x + clip->w || y >= clip->y + clip->h)
+        return;
+    int run;
+    Uint32 *dst = write_ptr(canvas, x, y, &run);
+    if (dst)
+        *dst = color;
+    mark_dirty(canvas, x, y, 1, 1);
+}
+
+// Paints the pixels of [x1, x2] on row y, already clipped, that the current
+// stroke has not covered yet, and marks them covered.
+static void fill_uncovered(Canvas *canvas, int x1, int x2, int y, Uint32 color) {
+    Uint64 *row = canvas->coverage + (size_t)y * canvas->coverage_stride;
+    canvas->covered_top = SDL_min(canvas->covered_top, y);
+    canvas->covered_bottom = SDL_max(canvas->covered_bottom, y);
+
+    int x = x1;
+    while (x <= x2) {
+        while (x <= x2 && (row[x >> 6] >> (x & 63) & 1))
+            x++;
+        int start = x;
+        while (x <= x2 && !(row[x >> 6] >> (x & 63) & 1)) {
+            row[x >> 6] |= (Uint64)1 << (x & 63);
+            x++;
+        }
+        if (start < x) {
+            fill_row(canvas, start, x - 1, y, color);
+            mark_dirty(canvas, start, y, x - start, 1);
+        }
+    }
+}
+
+void canvas_fill_span(Canvas *canvas, int x1, int x2, int y, Uint32 color) {
+    const SDL_Rect *clip = &canvas->clip;
+    if (y < clip->y || y >= clip->y + clip->h)
+        return;
+    if (x1 < clip->x)
+        x1 = clip->x;
+    if (x2 >= clip->x + clip->w)
+        x2 = clip->x + clip->w - 1;
+    if (x2 < x1)
+        return;
+
+    // Overwriting with an opaque color twice gives the same pixels
+    if (canvas->covering && (color >> 24) != 255) {
+        fill_uncovered(canvas, x1, x2, y, color);
+        return;
+    }
+    fill_row(canvas, x1, x2, y, color);
+    mark_dirty(canvas, x1, y, x2 - x1 + 1, 1);
+}
+
+void canvas_fill_rect(Canvas *canvas, const SDL_Rect *rect, Uint32 color) {
+    SDL_Rect area;
+    if (!canvas || !rect || !clip_rect(rect, &canvas->clip, &area))
+        return;
+
+    for (int y = area.y; y < area.y + area.h; y++) {
+        fill_row(canvas, area.x, area.x + area.w - 1, y, color);
+    }
+    dirty_region_add(&canvas->dirty, &area);
+}
+
+void canvas_blend_surface(Canvas *canvas, SDL_Surface *surface, int x, int y) {
+    if (!canvas || !surface)
+        return;
+
+    SDL_Surface *src = surface;
+    if (surface->format->format != CANVAS_PIXEL_FORMAT) {
+        src = SDL_ConvertSurfaceFormat(surface, CANVAS_PIXEL_FORMAT, 0);
+        if (!src)
+            return;
+    }
+
+    SDL_Rect area;
+    SDL_Rect bounds = {x, y, src->w, src->h};
+    if (!clip_rect(&bounds, &canvas->clip, &area)) {
+        if (src != surface)
+            SDL_FreeSurface(src);
+        return;
+    }
+
+    // Rendered text is straight alpha; premultiply one tile row at a time.
+    Uint32 premultiplied[TS];
+
+    SDL_LockSurface(src);
+    for (int py = area.y; py < area.y + area.h; py++) {
+        const Uint32 *src_row = (const Uint32 *)((const Uint8 *)src->pixels + (size_t)(py - y) * src->pitch);
+
+        int px = area.x;
+        while (px < area.x + area.w) {
+            int run;
+            Uint32 *dst = write_ptr(canvas, px, py, &run);
+            if (run > area.x + area.w - px)
+                run = area.x + area.w - px;
+
+            if (dst) {
+                pixels_premultiply(premultiplied, &src_row[px - x], run);
+                pixels_blend(dst, premultiplied, run);
+            }
+            px += run;
+        }
+    }
+    SDL_UnlockSurface(src);
+    dirty_region_add(&canvas->dirty, &area);
+
+    if (src != surface)
+        SDL_FreeSurface(src);
+}
+
+void canvas_blend_mask(Canvas *canvas, const Uint8 *mask, int pitch, const SDL_Rect *rect, Uint32 color) {
+    SDL_Rect area;
+    if (!canvas || !mask || !rect || (color >> 24) == 0 ||
+        !clip_rect(rect, &canvas->clip, &area))
+        return;
+
+    for (int py = area.y; py < area.y + area.h; py++) {
+        const Uint8 *mask_row = mask + (size_t)(py - rect->y) * pitch;
+
+        int px = area.x;
+        while (px < area.x + area.w) {
+            int run;
+            Uint32 *dst = write_ptr(canvas, px, py, &run);
+            if (run > area.x + area.w - px)
+                run = area.x + area.w - px;
+            if (dst)
+                pixels_blend_mask(dst, &mask_row[px - rect->x], run, color);
+            px += run;
+        }
+    }
+    dirty_region_add(&canvas->dirty, &area);
+}
+
+void canvas_read_pixels(const Canvas *canvas, const SDL_Rect *rect, Uint32 *dst, int pitch) {
+    for (int y = rect->y; y < rect->y + rect->h; y++) {
+        Uint32 *out = dst + (size_t)(y - rect->y) * pitch;
+        int x = rect->x;
+        while (x < rect->x + rect->w) {
+            int run;
+            const Uint32 *src = read_ptr(canvas, x, y, &run);
+            if (run > rect->x + rect->w - x)
+                run = rect->x + rect->w - x;
+            pixels_copy(out + (x - rect->x), src, run);
+            x += run;
+        }
+    }
+}
+
+Uint32 canvas_checksum(const Canvas *canvas) {
+    Uint32 hash = 2166136261u;
+    for (int y = 0; y < canvas->height; y++) {
+        int x = 0;
+        while (x < canvas->width) {
+            int run;
+            const Uint32 *src = read_ptr(canvas, x, y, &run);
+            run = SDL_min(run, canvas->width - x);
+            for (int i = 0; i < run; i++) {
+                Uint32 pixel = src[i];
+                for (int byte = 0; byte < 4; byte++) {
+                    hash = (hash ^ (pixel & 0xFF)) * 16777619u;
+                    pixel >>= 8;
+                }
+            }
+            x += run;
+        }
+    }
+    return hash;
+}
+
+void canvas_write_pixels(Canvas *canvas, const SDL_Rect *rect, const Uint32 *src, int pitch) {
+    for (int y = rect->y; y < rect->y + rect->h; y++) {
+        const Uint32 *in = src + (size_t)(y - rect->y) * pitch;
+        int x = rect->x;
+        while (x < rect->x + rect->w) {
+            int run;
+            Uint32 *dst = write_ptr(canvas, x, y, &run);
+            if (run > rect->x + rect->w - x)
+                run = rect->x + rect->w - x;
+            if (dst)
+                pixels_copy(dst, in + (x - rect->x), run);
+            x += run;
+        }
+    }
+    dirty_region_add(&canvas->dirty, rect);
+}
+
+void canvas_invalidate(Canvas *canvas, const SDL_Rect *rect) {
+    if (!canvas)
+        return;
+    if (!rect) {
+        mark_dirty(canvas, 0, 0, canvas->width, canvas->height);
+        return;
+    }
+
+    SDL_Rect area;
+    SDL_Rect bounds = {0, 0, canvas->width, canvas->height};
+    if (clip_rect(rect, &bounds, &area))
+        dirty_region_add(&canvas->dirty, &area);
+}
+
+void canvas_copy_to_surface(const Canvas *canvas, const SDL_Rect *rect, SDL_Surface *surface) {
+    if (!canvas || !rect || !surface)
+        return;
+
+    SDL_Rect area;
+    SDL_Rect bounds = {0, 0, SDL_min(canvas->width, surface->w), SDL_min(canvas->height, surface->h)};
+    if (!clip_rect(rect, &bounds, &area))
+        return;
+
+    SDL_LockSurface(surface);
+    for (int ty = area.y / TS; ty <= (area.y + area.h - 1) / TS; ty++) {
+        for (int tx = area.x / TS; tx <= (area.x + area.w - 1) / TS; tx++) {
+            SDL_Rect tile_rect = {tx * TS, ty * TS, TS, TS};
+            SDL_Rect part;
+            if (!SDL_IntersectRect(&area, &tile_rect, &part))
+                continue;
+
+            int run;
+            const Uint32 *src = read_ptr(canvas, part.x, part.y, &run);
+            Uint8 *dst = (Uint8 *)surface->pixels + (size_t)part.y * surface->pitch +
+                         (size_t)part.x * surface->format->BytesPerPixel;
+            SDL_ConvertPixels(part.w, part.h, CANVAS_PIXEL_FORMAT, src, TS * (int)sizeof(Uint32),
+                              surface->format->format, dst, surface->pitch);
+        }
+    }
+    SDL_UnlockSurface(surface);
+}
+
+void canvas_begin_recording(Canvas *canvas, TileDelta *delta) {
+    if (!canvas)
+        return;
+    canvas->recording = delta;
+    canvas->record_generation++;
+}
+
+void canvas_end_recording(Canvas *canvas) {
+    if (!canvas || !canvas->recording)
+        return;
+
+    TileDelta *delta = canvas->recording;
+    for (int i = 0; i < delta->count; i++) {
+        delta->after[i] = retain_tile(canvas->tiles[delta->indices[i]]);
+    }
+    canvas->recording = NULL;
+}
+
+bool canvas_begin_coverage(Canvas *canvas) {
+    if (!canvas)
+        return false;
+    if (!canvas->coverage) {
+        // Kept for the next stroke; only the rows a stroke touched are cleared
+        canvas->coverage = calloc((size_t)canvas->coverage_stride * canvas->height, sizeof(Uint64));
+        if (!canvas->coverage)
+            return false;
+    }
+    canvas->covering = true;
+    return true;
+}
+
+void canvas_end_coverage(Canvas *canvas) {
+    if (!canvas || !canvas->covering)
+        return;
+
+    if (canvas->covered_top <= canvas->covered_bottom) {
+        memset(canvas->coverage + (size_t)canvas->covered_top * canvas->coverage_stride, 0,
+               (size_t)(canvas->covered_bottom - canvas->covered_top + 1) * canvas->coverage_stride * sizeof(Uint64));
+    }
+    canvas->covering = false;
+    canvas->covered_top = canvas->height;
+    canvas->covered_bottom = -1;
+}
+
+void canvas_apply_delta(Canvas *canvas, const TileDelta *delta, bool undo) {
+    if (!canvas || !delta)
+        return;
+
+    for (int i = 0; i < delta->count; i++) {
+        CanvasTile *tile = undo ? delta->before[i] : delta->after[i];
+        int index = delta->indices[i];
+        if (!tile || canvas->tiles[index] == tile)
+            continue;
+
+        release_tile(canvas->tiles[index]);
+        canvas->tiles[index] = retain_tile(tile);
+        mark_tile_dirty(canvas, index);
+    }
+}
+
+void canvas_replace_tile(Canvas *canvas, int index, CanvasTile *tile) {
+    if (!canvas || !tile || index < 0 || index >= canvas->tiles_x * canvas->tiles_y)
+        return;
+    if (canvas->tiles[index] == tile)
+        return;
+
+    release_tile(canvas->tiles[index]);
+    canvas->tiles[index] = retain_tile(tile);
+    mark_tile_dirty(canvas, index);
+}
@@ -0,0 +1,92 @@
+#include "canvas/dirty_region.h"
+
+static inline long rect_area(const SDL_Rect *r) {
+    return (long)r->w * r->h;
+}
+
+static inline bool rect_contains(const SDL_Rect *outer, const SDL_Rect *inner) {
+    return inner->x >= outer->x && inner->y >= outer->y &&
+           inner->x + inner->w <= outer->x + outer->w &&
+           inner->y + inner->h <= outer->y + outer->h;
+}
+
+static inline SDL_Rect rect_union(const SDL_Rect *a, const SDL_Rect *b) {
+    int x1 = a->x < b->x ? a->x : b->x;
+    int y1 = a->y < b->y ? a->y : b->y;
+    int x2 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y2 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    return (SDL_Rect){x1, y1, x2 - x1, y2 - y1};
+}
+
+static void remove_rect(DirtyRegion *region, int index) {
+    region->rects[index] = region->rects[--region->count];
+}
+
+void dirty_region_clear(DirtyRegion *region) {
+    region->count = 0;
+}
+
+bool dirty_region_is_empty(const DirtyRegion *region) {
+    return region->count == 0;
+}
+
+void dirty_region_add(DirtyRegion *region, const SDL_Rect *rect) {
+    if (!region || !rect || rect->w <= 0 || rect->h <= 0)
+        return;
+
+    for (int i = 0; i < region->count; i++) {
+        if (rect_contains(&region->rects[i], rect))
+            return;
+    }
+
+    // Absorb every rectangle that merges cheaply, restarting after each
+    // merge since the grown rectangle may now reach others.
+    SDL_Rect merged = *rect;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < region->count; i++) {
+            SDL_Rect u = rect_union(&region->rects[i], &merged);
+            if (rect_area(&u) <= rect_area(&region->rects[i]) + rect_area(&merged) + DIRTY_REGION_MERGE_SLACK) {
+                merged = u;
+                remove_rect(region, i);
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (region->count < DIRTY_REGION_MAX_RECTS) {
+        region->rects[region->count++] = merged;
+        return;
+    }
+
+    int best = 0;
+    long best_growth = -1;
+    for (int i = 0; i < region->count; i++) {
+        SDL_Rect u = rect_union(&region->rects[i], &merged);
+        long growth = rect_area(&u) - rect_area(&region->rects[i]);
+        if (best_growth < 0 || growth < best_growth) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    region->rects[best] = rect_union(&region->rects[best], &merged);
+}
+
+void dirty_region_merge(DirtyRegion *region, const DirtyRegion *other) {
+    for (int i = 0; i < other->count; i++) {
+        dirty_region_add(region, &other->rects[i]);
+    }
+}
+
+void dirty_region_bounds(const DirtyRegion *region, SDL_Rect *bounds) {
+    if (region->count == 0) {
+        *bounds = (SDL_Rect){0, 0, 0, 0};
+        return;
+    }
+    *bounds = region->rects[0];
+    for (int i = 1; i < region->count; i++) {
+        *bounds = rect_union(bounds, &region->rects[i]);
+    }
+}
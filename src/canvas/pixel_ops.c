@@ -0,0 +1,267 @@
+#include "canvas/pixel_ops.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PIXEL_OPS_X86 1
+#include <immintrin.h>
+#endif
+
+// GCC and Clang compile the vector kernels for their ISA per function, so
+// the rest of the program keeps the baseline target and runs on any CPU.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET(isa) __attribute__((target(isa)))
+#else
+#define TARGET(isa)
+#endif
+
+typedef struct PixelKernels {
+    const char *name;
+    void (*fill)(Uint32 *dst, int count, Uint32 color);
+    void (*blend_color)(Uint32 *dst, int count, Uint32 color);
+    void (*blend)(Uint32 *dst, const Uint32 *src, int count);
+} PixelKernels;
+
+// Rounded division by 255 for values in [0, 255 * 255]
+static inline Uint32 div255(Uint32 v) {
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+// Source-over for premultiplied pixels: s + d * (255 - sa) / 255 per channel
+static inline Uint32 blend_pixel(Uint32 s, Uint32 d) {
+    Uint32 inv = 255 - (s >> 24);
+    Uint32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        Uint32 c = ((s >> shift) & 0xFF) + div255(((d >> shift) & 0xFF) * inv);
+        out |= (c > 255 ? 255 : c) << shift;
+    }
+    return out;
+}
+
+Uint32 premultiply_pixel(Uint32 pixel) {
+    Uint32 a = pixel >> 24;
+    if (a == 255)
+        return pixel;
+    return (a << 24) |
+           (div255(((pixel >> 16) & 0xFF) * a) << 16) |
+           (div255(((pixel >> 8) & 0xFF) * a) << 8) |
+           div255((pixel & 0xFF) * a);
+}
+
+Uint32 unpremultiply_pixel(Uint32 pixel) {
+    Uint32 a = pixel >> 24;
+    if (a == 255)
+        return pixel;
+    if (a == 0)
+        return 0;
+
+    Uint32 out = a << 24;
+    for (int shift = 0; shift < 24; shift += 8) {
+        Uint32 c = (((pixel >> shift) & 0xFF) * 255 + a / 2) / a;
+        out |= (c > 255 ? 255 : c) << shift;
+    }
+    return out;
+}
+
+void pixels_premultiply(Uint32 *dst, const Uint32 *src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = premultiply_pixel(src[i]);
+    }
+}
+
+static void fill_scalar(Uint32 *dst, int count, Uint32 color) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+static void blend_color_scalar(Uint32 *dst, int count, Uint32 color) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = blend_pixel(color, dst[i]);
+    }
+}
+
+static void blend_scalar(Uint32 *dst, const Uint32 *src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = blend_pixel(src[i], dst[i]);
+    }
+}
+
+static const PixelKernels scalar_kernels = {"scalar", fill_scalar, blend_color_scalar, blend_scalar};
+
+#ifdef PIXEL_OPS_X86
+
+// d * inv / 255 (rounded) on 16-bit lanes, via ((x + 128) * 257) >> 16
+TARGET("sse2") static inline __m128i scale_sse2(__m128i d, __m128i inv) {
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(d, inv), _mm_set1_epi16(128));
+    return _mm_mulhi_epu16(x, _mm_set1_epi16(257));
+}
+
+// 255 - alpha of each pixel, broadcast over its four 16-bit lanes
+TARGET("sse2") static inline __m128i inv_alpha_sse2(__m128i s16) {
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_sub_epi16(_mm_set1_epi16(255), a);
+}
+
+TARGET("sse2") static inline __m128i blend4_sse2(__m128i s, __m128i d) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = scale_sse2(_mm_unpacklo_epi8(d, zero), inv_alpha_sse2(_mm_unpacklo_epi8(s, zero)));
+    __m128i hi = scale_sse2(_mm_unpackhi_epi8(d, zero), inv_alpha_sse2(_mm_unpackhi_epi8(s, zero)));
+    return _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+}
+
+TARGET("sse2") static void fill_sse2(Uint32 *dst, int count, Uint32 color) {
+    const __m128i c = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i *)(dst + i), c);
+    }
+    fill_scalar(dst + i, count - i, color);
+}
+
+TARGET("sse2") static void blend_color_sse2(Uint32 *dst, int count, Uint32 color) {
+    const __m128i s = _mm_set1_epi32((int)color);
+    const __m128i inv = inv_alpha_sse2(_mm_unpacklo_epi8(s, _mm_setzero_si128()));
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = scale_sse2(_mm_unpacklo_epi8(d, zero), inv);
+        __m128i hi = scale_sse2(_mm_unpackhi_epi8(d, zero), inv);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+    blend_color_scalar(dst + i, count - i, color);
+}
+
+TARGET("sse2") static void blend_sse2(Uint32 *dst, const Uint32 *src, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), blend4_sse2(s, d));
+    }
+    blend_scalar(dst + i, src + i, count - i);
+}
+
+static const PixelKernels sse2_kernels = {"sse2", fill_sse2, blend_color_sse2, blend_sse2};
+
+TARGET("avx2") static inline __m256i scale_avx2(__m256i d, __m256i inv) {
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(d, inv), _mm256_set1_epi16(128));
+    return _mm256_mulhi_epu16(x, _mm256_set1_epi16(257));
+}
+
+TARGET("avx2") static inline __m256i inv_alpha_avx2(__m256i s16) {
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+}
+
+// Unpack and pack both work within 128-bit lanes, so pixel order is kept.
+TARGET("avx2") static inline __m256i blend8_avx2(__m256i s, __m256i d) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = scale_avx2(_mm256_unpacklo_epi8(d, zero), inv_alpha_avx2(_mm256_unpacklo_epi8(s, zero)));
+    __m256i hi = scale_avx2(_mm256_unpackhi_epi8(d, zero), inv_alpha_avx2(_mm256_unpackhi_epi8(s, zero)));
+    return _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+}
+
+TARGET("avx2") static void fill_avx2(Uint32 *dst, int count, Uint32 color) {
+    const __m256i c = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i *)(dst + i), c);
+    }
+    fill_scalar(dst + i, count - i, color);
+}
+
+TARGET("avx2") static void blend_color_avx2(Uint32 *dst, int count, Uint32 color) {
+    const __m256i s = _mm256_set1_epi32((int)color);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i inv = inv_alpha_avx2(_mm256_unpacklo_epi8(s, zero));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = scale_avx2(_mm256_unpacklo_epi8(d, zero), inv);
+        __m256i hi = scale_avx2(_mm256_unpackhi_epi8(d, zero), inv);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+    blend_color_scalar(dst + i, count - i, color);
+}
+
+TARGET("avx2") static void blend_avx2(Uint32 *dst, const Uint32 *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), blend8_avx2(s, d));
+    }
+    blend_scalar(dst + i, src + i, count - i);
+}
+
+static const PixelKernels avx2_kernels = {"avx2", fill_avx2, blend_color_avx2, blend_avx2};
+
+#endif // PIXEL_OPS_X86
+
+// Selected on first use. Replay workers may get here at the same time;
+// they all pick the same table, and the atomic publishes it safely.
+static void *kernels;
+
+static const PixelKernels *get_kernels(void) {
+    const PixelKernels *selected = SDL_AtomicGetPtr(&kernels);
+    if (selected)
+        return selected;
+
+    selected = &scalar_kernels;
+#ifdef PIXEL_OPS_X86
+    if (SDL_HasAVX2())
+        selected = &avx2_kernels;
+    else if (SDL_HasSSE2())
+        selected = &sse2_kernels;
+#endif
+    SDL_AtomicSetPtr(&kernels, (void *)selected);
+    return selected;
+}
+
+void pixels_fill(Uint32 *dst, int count, Uint32 color) {
+    get_kernels()->fill(dst, count, color);
+}
+
+void pixels_blend_color(Uint32 *dst, int count, Uint32 color) {
+    get_kernels()->blend_color(dst, count, color);
+}
+
+void pixels_blend(Uint32 *dst, const Uint32 *src, int count) {
+    get_kernels()->blend(dst, src, count);
+}
+
+void pixels_blend_mask(Uint32 *dst, const Uint8 *mask, int count, Uint32 color) {
+    const PixelKernels *k = get_kernels();
+    Uint32 src[64];
+
+    // Expand the coverage into premultiplied source pixels in small chunks,
+    // then composite each chunk with the vector blend.
+    while (count > 0) {
+        int n = count < 64 ? count : 64;
+        for (int i = 0; i < n; i++) {
+            Uint32 m = mask[i];
+            if (m == 255) {
+                src[i] = color;
+                continue;
+            }
+            src[i] = (div255((color >> 24) * m) << 24) |
+                     (div255(((color >> 16) & 0xFF) * m) << 16) |
+                     (div255(((color >> 8) & 0xFF) * m) << 8) |
+                     div255((color & 0xFF) * m);
+        }
+        k->blend(dst, src, n);
+        dst += n;
+        mask += n;
+        count -= n;
+    }
+}
+
+void pixels_copy(Uint32 *dst, const Uint32 *src, int count) {
+    memcpy(dst, src, (size_t)count * sizeof(Uint32));
+}
+
+const char *pixel_ops_backend(void) {
+    return get_kernels()->name;
+}
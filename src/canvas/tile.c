@@ -0,0 +1,102 @@
+#include "canvas/tile.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 8
+
+CanvasTile *create_tile(Uint32 color) {
+    CanvasTile *tile = malloc(sizeof(CanvasTile));
+    if (!tile)
+        return NULL;
+    SDL_AtomicSet(&tile->refcount, 1);
+    for (int i = 0; i < CANVAS_TILE_SIZE * CANVAS_TILE_SIZE; i++) {
+        tile->pixels[i] = color;
+    }
+    return tile;
+}
+
+CanvasTile *clone_tile(const CanvasTile *tile) {
+    CanvasTile *copy = malloc(sizeof(CanvasTile));
+    if (!copy)
+        return NULL;
+    SDL_AtomicSet(&copy->refcount, 1);
+    memcpy(copy->pixels, tile->pixels, sizeof(copy->pixels));
+    return copy;
+}
+
+CanvasTile *retain_tile(CanvasTile *tile) {
+    if (tile)
+        SDL_AtomicIncRef(&tile->refcount);
+    return tile;
+}
+
+void release_tile(CanvasTile *tile) {
+    if (tile && SDL_AtomicDecRef(&tile->refcount))
+        free(tile);
+}
+
+bool is_tile_shared(CanvasTile *tile) {
+    return SDL_AtomicGet(&tile->refcount) > 1;
+}
+
+void init_tile_delta(TileDelta *delta) {
+    delta->indices = NULL;
+    delta->before = NULL;
+    delta->after = NULL;
+    delta->count = 0;
+    delta->capacity = 0;
+    delta->evicted = false;
+}
+
+bool tile_delta_record(TileDelta *delta, int index, CanvasTile *before) {
+    if (delta->count >= delta->capacity) {
+        int new_capacity = delta->capacity ? delta->capacity * 2 : INITIAL_CAPACITY;
+
+        int *indices = realloc(delta->indices, new_capacity * sizeof(int));
+        if (!indices)
+            return false;
+        delta->indices = indices;
+
+        CanvasTile **tiles = realloc(delta->before, new_capacity * sizeof(CanvasTile *));
+        if (!tiles)
+            return false;
+        delta->before = tiles;
+
+        tiles = realloc(delta->after, new_capacity * sizeof(CanvasTile *));
+        if (!tiles)
+            return false;
+        delta->after = tiles;
+
+        delta->capacity = new_capacity;
+    }
+
+    delta->indices[delta->count] = index;
+    delta->before[delta->count] = retain_tile(before);
+    delta->after[delta->count] = NULL;
+    delta->count++;
+    return true;
+}
+
+void free_tile_delta(TileDelta *delta) {
+    if (!delta)
+        return;
+    for (int i = 0; i < delta->count; i++) {
+        release_tile(delta->before[i]);
+        release_tile(delta->after[i]);
+    }
+    free(delta->indices);
+    free(delta->before);
+    free(delta->after);
+    init_tile_delta(delta);
+}
+
+void evict_tile_delta(TileDelta *delta) {
+    if (!delta)
+        return;
+    free_tile_delta(delta);
+    delta->evicted = true;
+}
+
+size_t tile_delta_memory(const TileDelta *delta) {
+    return (size_t)delta->count * sizeof(CanvasTile);
+}
@@ -8,6 +8,7 @@ static void set_default_config(Config *config) {
     strncpy(config->log_dir, "logs", sizeof(config->log_dir));
     config->window_width = 800;
     config->window_height = 600;
+    config->target_fps = 0;
     strncpy(config->default_tool, "brush", sizeof(config->default_tool));
     config->brush_size = 4;
     config->brush_color.r = 0;
@@ -34,6 +35,17 @@ static void set_default_config(Config *config) {
     for (int i = 0; i < config->palette_count; i++) {
         config->palette_colors[i] = default_palette[i];
     }
+
+    config->history_memory_budget_mb = 256;
+    config->history_resident_budget_mb = 64;
+    config->history_dedup_points = true;
+    config->history_simplify_tolerance = 0.0f;
+    config->history_replay_threads = 0;
+
+    config->autosave_enabled = true;
+    config->autosave_checkpoint_entries = 256;
+    config->autosave_checkpoint_seconds = 60;
+    config->autosave_sync_ms = 1000;
 }
 
 bool load_config(const char *filename, Config *config) {
@@ -99,6 +111,10 @@ bool load_config(const char *filename, Config *config) {
         }
         if (cJSON_IsNumber(width)) config->window_width = width->valueint;
         if (cJSON_IsNumber(height)) config->window_height = height->valueint;
+
+        cJSON *target_fps = cJSON_GetObjectItemCaseSensitive(window, "target_fps");
+        if (cJSON_IsNumber(target_fps) && target_fps->valueint >= 0)
+            config->target_fps = target_fps->valueint;
     }
 
     cJSON *default_tool = cJSON_GetObjectItemCaseSensitive(json, "default_tool");
@@ -153,6 +169,48 @@ bool load_config(const char *filename, Config *config) {
         }
     }
 
+    cJSON *history = cJSON_GetObjectItemCaseSensitive(json, "history");
+    if (cJSON_IsObject(history)) {
+        cJSON *budget = cJSON_GetObjectItemCaseSensitive(history, "memory_budget_mb");
+        if (cJSON_IsNumber(budget) && budget->valueint > 0)
+            config->history_memory_budget_mb = budget->valueint;
+
+        cJSON *resident = cJSON_GetObjectItemCaseSensitive(history, "resident_budget_mb");
+        if (cJSON_IsNumber(resident) && resident->valueint >= 0)
+            config->history_resident_budget_mb = resident->valueint;
+
+        cJSON *dedup = cJSON_GetObjectItemCaseSensitive(history, "dedup_points");
+        if (cJSON_IsBool(dedup))
+            config->history_dedup_points = cJSON_IsTrue(dedup);
+
+        cJSON *tolerance = cJSON_GetObjectItemCaseSensitive(history, "simplify_tolerance");
+        if (cJSON_IsNumber(tolerance) && tolerance->valuedouble >= 0)
+            config->history_simplify_tolerance = (float)tolerance->valuedouble;
+
+        cJSON *threads = cJSON_GetObjectItemCaseSensitive(history, "replay_threads");
+        if (cJSON_IsNumber(threads) && threads->valueint >= 0)
+            config->history_replay_threads = threads->valueint;
+    }
+
+    cJSON *autosave = cJSON_GetObjectItemCaseSensitive(json, "autosave");
+    if (cJSON_IsObject(autosave)) {
+        cJSON *enabled = cJSON_GetObjectItemCaseSensitive(autosave, "enabled");
+        if (cJSON_IsBool(enabled))
+            config->autosave_enabled = cJSON_IsTrue(enabled);
+
+        cJSON *entries = cJSON_GetObjectItemCaseSensitive(autosave, "checkpoint_entries");
+        if (cJSON_IsNumber(entries) && entries->valueint > 0)
+            config->autosave_checkpoint_entries = entries->valueint;
+
+        cJSON *seconds = cJSON_GetObjectItemCaseSensitive(autosave, "checkpoint_seconds");
+        if (cJSON_IsNumber(seconds) && seconds->valueint > 0)
+            config->autosave_checkpoint_seconds = seconds->valueint;
+
+        cJSON *sync = cJSON_GetObjectItemCaseSensitive(autosave, "sync_ms");
+        if (cJSON_IsNumber(sync) && sync->valueint >= 0)
+            config->autosave_sync_ms = sync->valueint;
+    }
+
     cJSON_Delete(json);
     return true;
 }
@@ -0,0 +1,1229 @@
+#define _POSIX_C_SOURCE 200809L
+#include "context/document.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "context/logs.h"
+#include "context/profile.h"
+
+// Records start on this boundary so their payloads can be read in place
+#define RECORD_ALIGN 8
+
+// Largest canvas edge a document may declare
+#define DOCUMENT_MAX_SIZE 32768
+
+// Identifies an autosave journal; followed by its format version
+#define WAL_MAGIC "MOBPWAL\0"
+#define WAL_VERSION 1
+
+enum {
+    RECORD_BASE_TILE = 1,   // Canvas tile before the first undo entry
+    RECORD_TILE = 2,        // Canvas tile as saved
+    RECORD_ENTRY = 3,       // Undo entry at a history position
+    RECORD_COMMIT = 4,      // The records before it form a complete save
+    RECORD_POSITION = 5,    // Journal only: undo or redo moved the top of the history
+};
+
+typedef struct DocumentHeader {
+    char magic[8];          // DOCUMENT_MAGIC, not terminated
+    Uint32 version;         // DOCUMENT_VERSION
+    Uint32 width;           // Canvas width in pixels
+    Uint32 height;          // Canvas height in pixels
+    Uint32 tile_size;       // CANVAS_TILE_SIZE of the writer
+    Uint32 background;      // Pixel value of tiles without a base record
+    Uint32 reserved;
+} DocumentHeader;
+
+typedef struct RecordHeader {
+    Uint32 type;            // RECORD_* value
+    Uint32 checksum;        // FNV-1a of the payload
+    Uint64 size;            // Payload bytes, not counting the padding
+} RecordHeader;
+
+typedef struct TileRecord {
+    Uint32 index;           // Tile index (row-major)
+    Uint32 reserved;
+    Uint32 pixels[CANVAS_TILE_SIZE * CANVAS_TILE_SIZE];
+} TileRecord;
+
+// Followed by the entry's spans, its encoded points and its text
+typedef struct EntryRecord {
+    Uint32 position;        // Index in the undo history
+    Uint32 tool_type;
+    Uint32 color;           // R, G, B, A from the low byte up
+    Uint32 tool_size;
+    Uint32 point_count;
+    Uint32 span_count;
+    Uint32 stream_size;     // Bytes of encoded points
+    Uint32 text_size;       // Bytes of text including the terminator, 0 for none
+} EntryRecord;
+
+typedef struct CommitRecord {
+    Uint32 entry_count;     // Undo entries in the saved history
+    Uint32 sequence;        // Counts the commits made to the document
+} CommitRecord;
+
+typedef struct PositionRecord {
+    Uint32 entry_count;     // Undo entries after the undo or redo
+    Uint32 reserved;
+} PositionRecord;
+
+// Start of the autosave journal, followed by entry and position records
+typedef struct JournalHeader {
+    char magic[8];          // WAL_MAGIC
+    Uint32 version;         // WAL_VERSION
+    Uint32 sequence;        // Document commit the journaled changes follow
+} JournalHeader;
+
+// Tile a save writes. The job holds a reference, so the canvas copies the
+// tile before drawing on it and the worker reads stable pixels.
+typedef struct SaveTile {
+    Uint32 type;            // RECORD_BASE_TILE or RECORD_TILE
+    int index;
+    CanvasTile *tile;
+} SaveTile;
+
+// History entry a save writes. Its replay data is read in place: the job
+// pins the context's history until the main thread releases it, so the
+// data stays where it is while the worker serializes it.
+typedef struct SaveEntry {
+    Uint32 position;        // Position in the history timeline
+    Tool tool;
+    PointStream stream;     // Borrowed from the entry
+    const Span *spans;
+    int span_count;
+    const char *text;       // NULL for none
+} SaveEntry;
+
+struct SaveJob {
+    bool journal;           // Append `entries` to the autosave journal instead of saving
+    bool full;              // Rewrite the whole file instead of appending
+    DocumentHeader header;  // Written when the file is rewritten
+    SaveTile *tiles;        // Tiles to write
+    int tile_count;
+    SaveEntry *history;     // Entries to write, serialized by the worker
+    int history_count;
+    int position;           // Undo entries to journal a position record for, -1 for none
+    bool pinned;            // The job holds a pin_history() on the context
+    Uint8 *entries;         // Records the worker serialized from `history`
+    size_t entries_size;
+    Uint32 entry_count;     // Undo entries the save commits
+    SaveJob *next;
+};
+
+static Uint32 checksum(const void *data, size_t size) {
+    const Uint8 *bytes = data;
+    Uint32 hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t align_record(size_t offset) {
+    return (offset + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+static Uint32 pack_color(SDL_Color color) {
+    return (Uint32)color.r | (Uint32)color.g << 8 | (Uint32)color.b << 16 | (Uint32)color.a << 24;
+}
+
+static SDL_Color unpack_color(Uint32 color) {
+    return (SDL_Color){color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, color >> 24};
+}
+
+static bool write_all(int fd, const void *data, size_t size, off_t offset) {
+    const Uint8 *bytes = data;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += written;
+        size -= (size_t)written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool read_header(int fd, DocumentHeader *header) {
+    return pread(fd, header, sizeof(*header), 0) == (ssize_t)sizeof(*header) &&
+           memcmp(header->magic, DOCUMENT_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == DOCUMENT_VERSION &&
+           header->tile_size == CANVAS_TILE_SIZE &&
+           header->width > 0 && header->width <= DOCUMENT_MAX_SIZE &&
+           header->height > 0 && header->height <= DOCUMENT_MAX_SIZE;
+}
+
+bool document_peek_size(const char *path, int *width, int *height) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    DocumentHeader header;
+    bool valid = read_header(fd, &header);
+    close(fd);
+    if (!valid)
+        return false;
+
+    *width = (int)header.width;
+    *height = (int)header.height;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Loading
+
+static RecordHeader *record_at(Uint8 *map, size_t offset) {
+    return (RecordHeader *)(void *)(map + offset);
+}
+
+static size_t next_record(size_t offset, const RecordHeader *record) {
+    return align_record(offset + sizeof(RecordHeader) + (size_t)record->size);
+}
+
+// Walks the records and returns the end of the last intact commit. Anything
+// after it belongs to a save that did not finish.
+static size_t find_last_commit(Uint8 *map, size_t size, Uint32 *entry_count, Uint32 *sequence) {
+    size_t end = sizeof(DocumentHeader);
+    *entry_count = 0;
+    *sequence = 0;
+
+    size_t offset = end;
+    while (offset <= size && size - offset >= sizeof(RecordHeader)) {
+        RecordHeader *record = record_at(map, offset);
+        if (record->size > size - offset - sizeof(RecordHeader) ||
+            checksum(record + 1, (size_t)record->size) != record->checksum)
+            break;
+
+        offset = next_record(offset, record);
+        if (record->type == RECORD_COMMIT && record->size == sizeof(CommitRecord)) {
+            const CommitRecord *commit = (CommitRecord *)(void *)(record + 1);
+            *entry_count = commit->entry_count;
+            *sequence = commit->sequence;
+            end = offset;
+        }
+    }
+    return end;
+}
+
+static bool load_tile(Canvas *canvas, const TileRecord *record) {
+    CanvasTile *tile = create_tile(0);
+    if (!tile)
+        return false;
+    memcpy(tile->pixels, record->pixels, sizeof(tile->pixels));
+    canvas_replace_tile(canvas, (int)record->index, tile);
+    release_tile(tile);
+    return true;
+}
+
+// Points a history entry at an entry record inside the mapping. Its tiles
+// count as evicted, so undo and redo replay it.
+static bool read_entry(RecordHeader *record, HistoryEntry *entry) {
+    EntryRecord *fields = (EntryRecord *)(void *)(record + 1);
+    size_t spans_size = (size_t)fields->span_count * sizeof(Span);
+    Uint8 *spans = (Uint8 *)(fields + 1);
+    Uint8 *stream = spans + spans_size;
+    Uint8 *text = stream + fields->stream_size;
+
+    if (record->size < sizeof(EntryRecord) + spans_size + fields->stream_size + fields->text_size ||
+        fields->tool_type > TOOL_CLEAR || fields->point_count == 0 ||
+        (fields->text_size > 0 && text[fields->text_size - 1] != '\0'))
+        return false;
+
+    *entry = (HistoryEntry){
+        .count = (int)fields->point_count,
+        .stream = {stream, fields->stream_size, (int)fields->point_count, NULL},
+        .tool = {(ToolType)fields->tool_type, unpack_color(fields->color), (int)fields->tool_size},
+        .text_data = fields->text_size ? (char *)text : NULL,
+        .spans = fields->span_count ? (Span *)(void *)spans : NULL,
+        .span_count = (int)fields->span_count,
+        .mapped = true,
+    };
+    init_tile_delta(&entry->tiles);
+    entry->tiles.evicted = true;
+    return true;
+}
+
+// Records the context's canvas and history as the state the file holds
+static bool remember_saved(Document *document, const PaintContext *ctx) {
+    const History *undo = ctx->undo_stack;
+    if (undo->count > document->serial_capacity) {
+        Uint32 *serials = realloc(document->saved_serials, undo->count * sizeof(Uint32));
+        if (!serials)
+            return false;
+        document->saved_serials = serials;
+        document->serial_capacity = undo->count;
+    }
+
+    for (int i = 0; i < document->tile_count; i++) {
+        CanvasTile *tile = retain_tile(ctx->canvas->tiles[i]);
+        release_tile(document->saved_tiles[i]);
+        document->saved_tiles[i] = tile;
+    }
+    for (int i = 0; i < undo->count; i++) {
+        document->saved_serials[i] = undo->entries[i].serial;
+    }
+    document->saved_count = undo->count;
+    return true;
+}
+
+// Rebuilds the context from the records before `end`: base tiles first,
+// then the history on top of them, then the saved raster. Later records
+// replace earlier ones for the same tile or position.
+static bool restore_document(Document *document, PaintContext *ctx, const DocumentHeader *header,
+                             size_t end, Uint32 entry_count) {
+    int tile_count = document->tile_count;
+    RecordHeader **base = calloc(tile_count, sizeof(RecordHeader *));
+    RecordHeader **tiles = calloc(tile_count, sizeof(RecordHeader *));
+    RecordHeader **entries = calloc(entry_count ? entry_count : 1, sizeof(RecordHeader *));
+    if (!base || !tiles || !entries) {
+        free(base);
+        free(tiles);
+        free(entries);
+        log_error("Out of memory loading document %s", document->path);
+        return false;
+    }
+
+    for (size_t offset = sizeof(DocumentHeader); offset < end;) {
+        RecordHeader *record = record_at(document->map, offset);
+        offset = next_record(offset, record);
+
+        if (record->type == RECORD_ENTRY && record->size >= sizeof(EntryRecord)) {
+            Uint32 position = ((EntryRecord *)(void *)(record + 1))->position;
+            if (position < entry_count)
+                entries[position] = record;
+        } else if ((record->type == RECORD_BASE_TILE || record->type == RECORD_TILE) &&
+                   record->size == sizeof(TileRecord)) {
+            Uint32 index = ((TileRecord *)(void *)(record + 1))->index;
+            if (index < (Uint32)tile_count)
+                (record->type == RECORD_BASE_TILE ? base : tiles)[index] = record;
+        }
+    }
+
+    bool ok = true;
+    Canvas *canvas = ctx->canvas;
+    ctx->background = header->background;
+    canvas_clear(canvas, header->background);
+    for (int i = 0; i < tile_count && ok; i++) {
+        if (base[i])
+            ok = load_tile(canvas, (TileRecord *)(void *)(base[i] + 1));
+    }
+
+    // The base raster is what undoing every entry leads back to
+    size_t budget = ctx->keyframes.memory_budget;
+    free_keyframes(&ctx->keyframes);
+    ok = ok && init_keyframes(&ctx->keyframes, canvas, budget);
+
+    Uint32 count = 0;
+    for (; ok && count < entry_count; count++) {
+        HistoryEntry entry;
+        if (!entries[count] || !read_entry(entries[count], &entry)) {
+            log_error("History in %s is damaged after entry %u", document->path, count);
+            break;
+        }
+        entry.serial = ctx->next_serial++;
+        if (!push_history(ctx->undo_stack, &entry)) {
+            ok = false;
+            break;
+        }
+    }
+
+    for (int i = 0; i < tile_count && ok; i++) {
+        if (tiles[i])
+            ok = load_tile(canvas, (TileRecord *)(void *)(tiles[i] + 1));
+    }
+    canvas_invalidate(canvas, NULL);
+
+    free(base);
+    free(tiles);
+    free(entries);
+
+    if (!ok || !remember_saved(document, ctx)) {
+        log_error("Out of memory loading document %s", document->path);
+        return false;
+    }
+    log_info("Loaded %s: %u history entries.", document->path, count);
+    return true;
+}
+
+static bool load_document(Document *document, PaintContext *ctx) {
+    int fd = open(document->path, document->read_only ? O_RDONLY : O_RDWR);
+    if (fd < 0) {
+        if (errno == ENOENT && !document->read_only)
+            return true;    // New document, created on the first save
+        log_error("Failed to open document %s: %s", document->path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    DocumentHeader header;
+    if (fstat(fd, &st) != 0 || !read_header(fd, &header)) {
+        log_error("%s is not a MobPaint document; it will not be overwritten", document->path);
+        close(fd);
+        return false;
+    }
+    if ((int)header.width != ctx->canvas->width || (int)header.height != ctx->canvas->height) {
+        log_error("Document %s is %ux%u but the canvas is %dx%d", document->path,
+                  header.width, header.height, ctx->canvas->width, ctx->canvas->height);
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        log_error("Failed to map document %s: %s", document->path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    document->fd = fd;
+    document->map = map;
+    document->map_size = (size_t)st.st_size;
+
+    Uint32 entry_count;
+    size_t end = find_last_commit(document->map, document->map_size, &entry_count, &document->sequence);
+    if (!restore_document(document, ctx, &header, end, entry_count))
+        return false;
+
+    // Drop a save that was cut short so the next one appends after the
+    // last commit. Nothing loaded points past it.
+    if (end < document->map_size && !document->read_only && ftruncate(fd, (off_t)end) != 0)
+        log_error("Failed to truncate document %s: %s", document->path, strerror(errno));
+    document->end = end;
+    document->has_file = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Saving (worker thread)
+
+static size_t entry_record_size(const SaveEntry *entry) {
+    size_t text_size = entry->text ? strlen(entry->text) + 1 : 0;
+    return sizeof(EntryRecord) + (size_t)entry->span_count * sizeof(Span) + entry->stream.size + text_size;
+}
+
+// Turns the job's history entries into entry records, followed by a
+// position record if the job has one.
+static bool serialize_records(SaveJob *job) {
+    size_t size = job->position >= 0 ? sizeof(RecordHeader) + sizeof(PositionRecord) : 0;
+    for (int i = 0; i < job->history_count; i++) {
+        size += align_record(sizeof(RecordHeader) + entry_record_size(&job->history[i]));
+    }
+    if (size == 0)
+        return true;
+
+    job->entries = calloc(1, size);
+    if (!job->entries)
+        return false;
+    job->entries_size = size;
+
+    Uint8 *out = job->entries;
+    for (int i = 0; i < job->history_count; i++) {
+        const SaveEntry *entry = &job->history[i];
+        size_t spans_size = (size_t)entry->span_count * sizeof(Span);
+        size_t text_size = entry->text ? strlen(entry->text) + 1 : 0;
+
+        RecordHeader *record = (RecordHeader *)(void *)out;
+        *record = (RecordHeader){RECORD_ENTRY, 0, entry_record_size(entry)};
+        EntryRecord *fields = (EntryRecord *)(void *)(record + 1);
+        *fields = (EntryRecord){
+            .position = entry->position,
+            .tool_type = (Uint32)entry->tool.type,
+            .color = pack_color(entry->tool.color),
+            .tool_size = (Uint32)entry->tool.size,
+            .point_count = (Uint32)entry->stream.count,
+            .span_count = (Uint32)entry->span_count,
+            .stream_size = (Uint32)entry->stream.size,
+            .text_size = (Uint32)text_size,
+        };
+
+        Uint8 *data = (Uint8 *)(fields + 1);
+        if (spans_size)
+            memcpy(data, entry->spans, spans_size);
+        data += spans_size;
+        if (entry->stream.size)
+            memcpy(data, entry->stream.data, entry->stream.size);
+        data += entry->stream.size;
+        if (text_size)
+            memcpy(data, entry->text, text_size);
+
+        out += align_record(sizeof(RecordHeader) + (size_t)record->size);
+    }
+
+    if (job->position >= 0) {
+        RecordHeader *record = (RecordHeader *)(void *)out;
+        *record = (RecordHeader){RECORD_POSITION, 0, sizeof(PositionRecord)};
+        *(PositionRecord *)(void *)(record + 1) = (PositionRecord){(Uint32)job->position, 0};
+    }
+    return true;
+}
+
+// Fills in the checksums of the records a job carries
+static void seal_records(SaveJob *job) {
+    for (size_t at = 0; at < job->entries_size; ) {
+        RecordHeader *record = record_at(job->entries, at);
+        record->checksum = checksum(record + 1, (size_t)record->size);
+        at = next_record(at, record);
+    }
+}
+
+static void free_save_job(SaveJob *job) {
+    for (int i = 0; i < job->tile_count; i++) {
+        release_tile(job->tiles[i].tile);
+    }
+    free(job->tiles);
+    free(job->history);
+    free(job->entries);
+    free(job);
+}
+
+static bool is_solid_tile(const CanvasTile *tile, Uint32 color) {
+    for (int i = 0; i < CANVAS_TILE_SIZE * CANVAS_TILE_SIZE; i++) {
+        if (tile->pixels[i] != color)
+            return false;
+    }
+    return true;
+}
+
+// Makes a rename in the document's directory durable
+static void sync_directory(const char *path) {
+    char dir[512];
+    const char *slash = strrchr(path, '/');
+    if (!slash)
+        snprintf(dir, sizeof(dir), ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static bool write_commit(int fd, size_t *offset, Uint32 entry_count, Uint32 sequence) {
+    struct {
+        RecordHeader header;
+        CommitRecord commit;
+    } record = {{RECORD_COMMIT, 0, sizeof(CommitRecord)}, {entry_count, sequence}};
+    record.header.checksum = checksum(&record.commit, sizeof(record.commit));
+
+    if (!write_all(fd, &record, sizeof(record), (off_t)*offset))
+        return false;
+    *offset += sizeof(record);
+    return true;
+}
+
+// Writes the job's records, syncs them and then commits them. A full save
+// goes to a temporary file that replaces the document once complete;
+// history loaded from the old file stays valid through its mapping.
+static bool write_job(Document *document, SaveJob *job) {
+    PROFILE_SCOPE("write_save");
+    char temp[512];
+    int fd = document->fd;
+    size_t offset = document->end;
+
+    if (job->full) {
+        snprintf(temp, sizeof(temp), "%s.tmp", document->path);
+        fd = open(temp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            log_error("Failed to create %s: %s", temp, strerror(errno));
+            return false;
+        }
+        if (!write_all(fd, &job->header, sizeof(job->header), 0)) {
+            close(fd);
+            unlink(temp);
+            return false;
+        }
+        offset = sizeof(job->header);
+    }
+
+    struct {
+        RecordHeader header;
+        TileRecord tile;
+    } *block = malloc(sizeof(*block));
+    bool ok = block != NULL;
+
+    for (int i = 0; i < job->tile_count && ok; i++) {
+        const SaveTile *save = &job->tiles[i];
+        if (save->type == RECORD_BASE_TILE && is_solid_tile(save->tile, job->header.background))
+            continue;   // The loader fills missing base tiles with the background
+
+        block->tile.index = (Uint32)save->index;
+        block->tile.reserved = 0;
+        memcpy(block->tile.pixels, save->tile->pixels, sizeof(block->tile.pixels));
+        block->header = (RecordHeader){save->type, checksum(&block->tile, sizeof(block->tile)), sizeof(block->tile)};
+        ok = write_all(fd, block, sizeof(*block), (off_t)offset);
+        offset += sizeof(*block);
+    }
+    free(block);
+
+    if (ok && !serialize_records(job)) {
+        log_error("Out of memory writing document %s", document->path);
+        ok = false;
+    }
+    seal_records(job);
+    ok = ok && write_all(fd, job->entries, job->entries_size, (off_t)offset);
+    offset += job->entries_size;
+
+    // The commit must not reach the disk before the records it covers
+    Uint32 sequence = document->sequence + 1;
+    ok = ok && fdatasync(fd) == 0 && write_commit(fd, &offset, job->entry_count, sequence) && fdatasync(fd) == 0;
+
+    if (job->full) {
+        if (ok && rename(temp, document->path) == 0) {
+            sync_directory(document->path);
+            if (document->fd >= 0)
+                close(document->fd);
+            document->fd = fd;
+            document->end = offset;
+            document->sequence = sequence;
+            return true;
+        }
+        log_error("Failed to write document %s: %s", document->path, strerror(errno));
+        close(fd);
+        unlink(temp);
+        return false;
+    }
+
+    if (!ok) {
+        log_error("Failed to write document %s: %s", document->path, strerror(errno));
+        if (ftruncate(fd, (off_t)document->end) != 0)
+            log_error("Failed to roll back document %s: %s", document->path, strerror(errno));
+        return false;
+    }
+    document->end = offset;
+    document->sequence = sequence;
+    return true;
+}
+
+static void journal_path(const Document *document, char *path, size_t size) {
+    snprintf(path, size, "%s" DOCUMENT_WAL_SUFFIX, document->path);
+}
+
+// Appends a job's records to the autosave journal, starting it with a header
+// when it is empty. After a failed append the journal stays as it is until
+// the next save makes it obsolete.
+static bool write_journal(Document *document, SaveJob *job) {
+    PROFILE_SCOPE("write_journal");
+    if (document->wal_fd < 0 || document->wal_failed)
+        return false;
+
+    if (document->wal_end == 0) {
+        JournalHeader header = {.version = WAL_VERSION, .sequence = document->sequence};
+        memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+        document->wal_failed = !write_all(document->wal_fd, &header, sizeof(header), 0);
+        if (!document->wal_failed)
+            document->wal_end = sizeof(header);
+    }
+
+    if (!document->wal_failed && !serialize_records(job)) {
+        log_error("Out of memory writing autosave journal for %s", document->path);
+        document->wal_failed = true;
+        return false;
+    }
+    seal_records(job);
+    if (document->wal_failed ||
+        !write_all(document->wal_fd, job->entries, job->entries_size, (off_t)document->wal_end)) {
+        log_error("Failed to write autosave journal for %s: %s", document->path, strerror(errno));
+        document->wal_failed = true;
+        return false;
+    }
+    document->wal_end += job->entries_size;
+    return true;
+}
+
+static void sync_journal(Document *document) {
+    if (fdatasync(document->wal_fd) != 0)
+        log_error("Failed to sync autosave journal for %s: %s", document->path, strerror(errno));
+}
+
+// Empties the journal once a save committed everything it held
+static void reset_journal(Document *document) {
+    if (document->wal_fd < 0)
+        return;
+    if (ftruncate(document->wal_fd, 0) != 0) {
+        // The stale journal names an older commit, so it is never replayed
+        log_error("Failed to reset autosave journal for %s: %s", document->path, strerror(errno));
+        document->wal_failed = true;
+        return;
+    }
+    document->wal_end = 0;
+    document->wal_failed = false;
+}
+
+static struct timespec deadline_after(int ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+static bool deadline_passed(const struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec > deadline->tv_sec ||
+           (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static void *save_worker(void *arg) {
+    Document *document = arg;
+    profile_thread_name("save");
+    bool unsynced = false;      // Journal records written but not yet synced
+    struct timespec sync_deadline = {0, 0};
+
+    pthread_mutex_lock(&document->lock);
+    for (;;) {
+        // Journal records that arrive within the sync interval share one
+        // fdatasync; the interval bounds how much a crash can lose.
+        if (unsynced && !document->queue && !document->quit) {
+            if (pthread_cond_timedwait(&document->wake, &document->lock, &sync_deadline) != ETIMEDOUT)
+                continue;
+            pthread_mutex_unlock(&document->lock);
+            sync_journal(document);
+            unsynced = false;
+            pthread_mutex_lock(&document->lock);
+            continue;
+        }
+        while (!document->queue && !document->quit)
+            pthread_cond_wait(&document->wake, &document->lock);
+        SaveJob *job = document->queue;
+        if (!job)
+            break;
+        document->queue = job->next;
+        if (!document->queue)
+            document->queue_tail = NULL;
+
+        // An incremental save builds on the previous one; after a failure
+        // only a full save can bring the file up to date.
+        bool journal = job->journal;
+        bool full = job->full;
+        bool skip = !journal && !full && (document->failed || document->fd < 0);
+        pthread_mutex_unlock(&document->lock);
+
+        bool ok = true;
+        if (journal) {
+            if (write_journal(document, job) && !unsynced) {
+                unsynced = true;
+                sync_deadline = deadline_after(document->sync_ms);
+            }
+            if (unsynced && deadline_passed(&sync_deadline)) {
+                sync_journal(document);
+                unsynced = false;
+            }
+        } else {
+            ok = !skip && write_job(document, job);
+            if (ok) {
+                reset_journal(document);
+                unsynced = false;
+            }
+        }
+
+        // The main thread releases the job, and with it the history pin
+        pthread_mutex_lock(&document->lock);
+        job->next = document->finished;
+        document->finished = job;
+        document->in_flight--;
+        pthread_cond_broadcast(&document->idle);
+        if (ok && full)
+            document->failed = false;
+        else if (!ok)
+            document->failed = true;
+    }
+    pthread_mutex_unlock(&document->lock);
+
+    if (unsynced)
+        sync_journal(document);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Saving (main thread)
+
+static void add_save_tile(SaveJob *job, Uint32 type, int index, CanvasTile *tile) {
+    job->tiles[job->tile_count++] = (SaveTile){type, index, retain_tile(tile)};
+}
+
+// Entry at a position of the history timeline: the undo entries, followed
+// by the redo entries in the order redo brings them back
+static const HistoryEntry *timeline_entry(const PaintContext *ctx, int position) {
+    const History *undo = ctx->undo_stack;
+    const History *redo = ctx->redo_stack;
+    if (position < undo->count)
+        return &undo->entries[position];
+    return &redo->entries[redo->count - 1 - (position - undo->count)];
+}
+
+// Lists the timeline entries [first, last) for the worker to serialize,
+// followed by a position record unless `position` is negative. Only the
+// entries' pointers are taken; queue_job() pins the history they point into.
+static bool collect_entries(SaveJob *job, const PaintContext *ctx, int first, int last, int position) {
+    job->position = position;
+    if (last <= first)
+        return true;
+
+    job->history = malloc((size_t)(last - first) * sizeof(SaveEntry));
+    if (!job->history)
+        return false;
+    for (int i = first; i < last; i++) {
+        const HistoryEntry *entry = timeline_entry(ctx, i);
+        job->history[job->history_count++] = (SaveEntry){
+            .position = (Uint32)i,
+            .tool = entry->tool,
+            .stream = {entry->stream.data, entry->stream.size, entry->stream.count, NULL},
+            .spans = entry->spans,
+            .span_count = entry->span_count,
+            .text = entry->text_data,
+        };
+    }
+    return true;
+}
+
+// Collects what changed since the last save. A full save instead takes the
+// base raster, every tile that differs from it and the whole history.
+static SaveJob *build_save_job(Document *document, PaintContext *ctx, bool full) {
+    const Canvas *canvas = ctx->canvas;
+    const History *undo = ctx->undo_stack;
+
+    SaveJob *job = calloc(1, sizeof(SaveJob));
+    if (!job)
+        return NULL;
+    job->tiles = malloc(2 * document->tile_count * sizeof(SaveTile));
+    if (!job->tiles) {
+        free(job);
+        return NULL;
+    }
+
+    job->full = full;
+    job->entry_count = (Uint32)undo->count;
+    memcpy(job->header.magic, DOCUMENT_MAGIC, sizeof(job->header.magic));
+    job->header.version = DOCUMENT_VERSION;
+    job->header.width = (Uint32)canvas->width;
+    job->header.height = (Uint32)canvas->height;
+    job->header.tile_size = CANVAS_TILE_SIZE;
+    job->header.background = ctx->background;
+
+    int first = 0;
+    if (full) {
+        const Keyframe *base = find_keyframe(&ctx->keyframes, 0);
+        for (int i = 0; i < document->tile_count; i++) {
+            CanvasTile *base_tile = base ? base->snapshot->tiles[i] : NULL;
+            if (base_tile)
+                add_save_tile(job, RECORD_BASE_TILE, i, base_tile);
+            if (canvas->tiles[i] != base_tile)
+                add_save_tile(job, RECORD_TILE, i, canvas->tiles[i]);
+        }
+    } else {
+        for (int i = 0; i < document->tile_count; i++) {
+            if (canvas->tiles[i] != document->saved_tiles[i])
+                add_save_tile(job, RECORD_TILE, i, canvas->tiles[i]);
+        }
+        int common = SDL_min(undo->count, document->saved_count);
+        while (first < common && undo->entries[first].serial == document->saved_serials[first])
+            first++;
+    }
+
+    if (!collect_entries(job, ctx, first, undo->count, -1)) {
+        free_save_job(job);
+        return NULL;
+    }
+    return job;
+}
+
+static void queue_job(Document *document, PaintContext *ctx, SaveJob *job) {
+    if (job->history_count > 0) {
+        pin_history(ctx);
+        job->pinned = true;
+    }
+    pthread_mutex_lock(&document->lock);
+    document->in_flight++;
+    if (document->queue_tail)
+        document->queue_tail->next = job;
+    else
+        document->queue = job;
+    document->queue_tail = job;
+    pthread_cond_signal(&document->wake);
+    pthread_mutex_unlock(&document->lock);
+}
+
+// Records the context's history timeline as what the journal holds
+static bool remember_logged(Document *document, const PaintContext *ctx) {
+    int total = ctx->undo_stack->count + ctx->redo_stack->count;
+    if (total > document->logged_capacity) {
+        Uint32 *serials = realloc(document->logged_serials, total * sizeof(Uint32));
+        if (!serials)
+            return false;
+        document->logged_serials = serials;
+        document->logged_capacity = total;
+    }
+
+    for (int i = 0; i < total; i++) {
+        document->logged_serials[i] = timeline_entry(ctx, i)->serial;
+    }
+    document->logged_total = total;
+    document->logged_count = ctx->undo_stack->count;
+    document->logged_version = ctx->history_version;
+    return true;
+}
+
+// Journals how the history changed since it was last journaled: the entries
+// from the first timeline position that differs, each replacing the history
+// from its position on, then where undo or redo left the top.
+static void journal_history(Document *document, PaintContext *ctx) {
+    int total = ctx->undo_stack->count + ctx->redo_stack->count;
+    int count = ctx->undo_stack->count;
+
+    int first = 0;
+    int common = SDL_min(total, document->logged_total);
+    while (first < common && timeline_entry(ctx, first)->serial == document->logged_serials[first])
+        first++;
+
+    int last = first < total ? total : first;
+    int top = first < total ? total : document->logged_count;
+    if (first == last && count == top) {
+        document->logged_version = ctx->history_version;
+        return;
+    }
+
+    SaveJob *job = calloc(1, sizeof(SaveJob));
+    if (!job || !collect_entries(job, ctx, first, last, count != top ? count : -1) ||
+        !remember_logged(document, ctx)) {
+        // Not journaled; the next call tries again
+        if (job)
+            free_save_job(job);
+        log_error("Out of memory journaling changes to %s", document->path);
+        return;
+    }
+    job->journal = true;
+    queue_job(document, ctx, job);
+
+    if (document->pending_changes == 0)
+        document->pending_since = SDL_GetTicks();
+    document->pending_changes += last - first + (count != top);
+}
+
+// Frees the jobs the worker is done with and drops their history pins
+static void release_finished_jobs(Document *document, PaintContext *ctx) {
+    pthread_mutex_lock(&document->lock);
+    SaveJob *job = document->finished;
+    document->finished = NULL;
+    pthread_mutex_unlock(&document->lock);
+
+    while (job) {
+        SaveJob *next = job->next;
+        if (job->pinned)
+            unpin_history(ctx);
+        free_save_job(job);
+        job = next;
+    }
+}
+
+bool save_document(Document *document, PaintContext *ctx) {
+    if (!document || document->disabled || !ctx || !ctx->canvas || ctx->current_stroke)
+        return false;
+    release_finished_jobs(document, ctx);
+
+    // Everything before the save goes to the journal too, so it stays
+    // complete should the save fail
+    if (document->autosave && ctx->history_version != document->logged_version)
+        journal_history(document, ctx);
+
+    // Appending replaces tiles without reclaiming the old records; once a
+    // whole canvas worth piled up the file is rewritten instead.
+    pthread_mutex_lock(&document->lock);
+    bool full = !document->has_file || document->failed || document->appended_tiles > document->tile_count;
+    pthread_mutex_unlock(&document->lock);
+
+    SaveJob *job = build_save_job(document, ctx, full);
+    if (!job) {
+        log_error("Out of memory saving %s", document->path);
+        return false;
+    }
+    if (!full && job->tile_count == 0 && job->history_count == 0 &&
+        ctx->undo_stack->count == document->saved_count) {
+        free_save_job(job);
+        document->pending_changes = 0;
+        return true;
+    }
+
+    // The queued job is the new reference for the next save, even before
+    // it reaches the disk. Should it fail, the worker flags a full rewrite.
+    if (!remember_saved(document, ctx)) {
+        free_save_job(job);
+        log_error("Out of memory saving %s", document->path);
+        return false;
+    }
+    document->has_file = true;
+    document->appended_tiles = full ? 0 : document->appended_tiles + job->tile_count;
+    document->pending_changes = 0;
+    queue_job(document, ctx, job);
+    return true;
+}
+
+void autosave_document(Document *document, PaintContext *ctx) {
+    if (!document || !ctx || document->disabled || !document->autosave)
+        return;
+    PROFILE_SCOPE("autosave_document");
+    release_finished_jobs(document, ctx);
+    if (ctx->history_version != document->logged_version)
+        journal_history(document, ctx);
+
+    // Saving is the journal's checkpoint, which bounds how much history a
+    // recovery has to replay
+    if (document->pending_changes > 0 && !ctx->current_stroke &&
+        (document->pending_changes >= document->checkpoint_entries ||
+         SDL_GetTicks() - document->pending_since >= document->checkpoint_ms))
+        save_document(document, ctx);
+}
+
+void wait_for_saves(Document *document, PaintContext *ctx) {
+    if (!document || !document->worker_running)
+        return;
+    pthread_mutex_lock(&document->lock);
+    while (document->in_flight > 0)
+        pthread_cond_wait(&document->idle, &document->lock);
+    pthread_mutex_unlock(&document->lock);
+    release_finished_jobs(document, ctx);
+}
+
+// ---------------------------------------------------------------------------
+// Recovery
+
+// Copies a journaled entry into memory owned by the context
+static bool copy_entry(RecordHeader *record, PaintContext *ctx, HistoryEntry *entry) {
+    HistoryEntry source;
+    if (!read_entry(record, &source))
+        return false;
+
+    *entry = (HistoryEntry){.count = source.count, .tool = source.tool, .span_count = source.span_count};
+    bool ok = copy_point_stream(&entry->stream, &ctx->point_pool, &source.stream);
+    if (ok && source.spans) {
+        entry->spans = malloc(source.span_count * sizeof(Span));
+        ok = entry->spans != NULL;
+        if (ok)
+            memcpy(entry->spans, source.spans, source.span_count * sizeof(Span));
+    }
+    if (ok && source.text_data) {
+        entry->text_data = malloc(strlen(source.text_data) + 1);
+        ok = entry->text_data != NULL;
+        if (ok)
+            strcpy(entry->text_data, source.text_data);
+    }
+    if (!ok)
+        free_history_entry(entry);
+    return ok;
+}
+
+// Undoes or redoes until the undo history holds `position` entries
+static bool seek_history(PaintContext *ctx, int position) {
+    while (ctx->undo_stack->count > position && paint_context_undo(ctx)) {}
+    while (ctx->undo_stack->count < position && paint_context_redo(ctx)) {}
+    return ctx->undo_stack->count == position;
+}
+
+// Replays the journal a session left behind if it continues the loaded
+// commit; otherwise the document already holds its changes. Returns the
+// number of changes replayed and sets `end` past the last of them.
+static int recover_journal(Document *document, PaintContext *ctx, size_t *end) {
+    struct stat st;
+    *end = 0;
+    if (fstat(document->wal_fd, &st) != 0 || (size_t)st.st_size < sizeof(JournalHeader))
+        return 0;
+
+    size_t size = (size_t)st.st_size;
+    Uint8 *data = malloc(size);
+    if (!data || pread(document->wal_fd, data, size, 0) != (ssize_t)size) {
+        log_error("Failed to read autosave journal for %s", document->path);
+        free(data);
+        return 0;
+    }
+
+    const JournalHeader *header = (const JournalHeader *)(void *)data;
+    if (memcmp(header->magic, WAL_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != WAL_VERSION || header->sequence != document->sequence) {
+        free(data);
+        return 0;
+    }
+
+    int replayed = 0;
+    size_t offset = sizeof(JournalHeader);
+    *end = offset;
+    while (offset <= size && size - offset >= sizeof(RecordHeader)) {
+        RecordHeader *record = record_at(data, offset);
+        if (record->size > size - offset - sizeof(RecordHeader) ||
+            checksum(record + 1, (size_t)record->size) != record->checksum)
+            break;
+
+        bool applied = false;
+        if (record->type == RECORD_ENTRY && record->size >= sizeof(EntryRecord)) {
+            const EntryRecord *fields = (const EntryRecord *)(void *)(record + 1);
+            HistoryEntry entry;
+            applied = seek_history(ctx, (int)fields->position) && copy_entry(record, ctx, &entry) &&
+                      commit_history_entry(ctx, &entry);
+        } else if (record->type == RECORD_POSITION && record->size == sizeof(PositionRecord)) {
+            applied = seek_history(ctx, (int)((const PositionRecord *)(void *)(record + 1))->entry_count);
+        }
+        if (!applied)
+            break;
+
+        offset = next_record(offset, record);
+        *end = offset;
+        replayed++;
+    }
+    free(data);
+    return replayed;
+}
+
+// Opens the autosave journal next to the document and replays what a
+// previous session left in it. Returns the number of changes recovered.
+// A read-only document only reads an existing journal.
+static int open_journal(Document *document, PaintContext *ctx) {
+    char path[512];
+    journal_path(document, path, sizeof(path));
+    document->wal_fd = document->read_only ? open(path, O_RDONLY) : open(path, O_RDWR | O_CREAT, 0644);
+    if (document->wal_fd < 0) {
+        if (!document->read_only || errno != ENOENT)
+            log_error("Failed to open autosave journal %s: %s", path, strerror(errno));
+        return 0;
+    }
+
+    size_t end;
+    int recovered = recover_journal(document, ctx, &end);
+    if (document->read_only)
+        return recovered;
+
+    document->autosave = true;
+    if (recovered == 0)
+        end = 0;
+    if (ftruncate(document->wal_fd, (off_t)end) != 0)
+        log_error("Failed to truncate autosave journal %s: %s", path, strerror(errno));
+    document->wal_end = end;
+    return recovered;
+}
+
+// ---------------------------------------------------------------------------
+
+// Sets up the document and loads the file at `path`, if there is one
+static bool init_document(Document *document, const char *path, PaintContext *ctx, bool read_only) {
+    *document = (Document){.fd = -1, .wal_fd = -1, .read_only = read_only};
+    pthread_mutex_init(&document->lock, NULL);
+    pthread_cond_init(&document->wake, NULL);
+    pthread_cond_init(&document->idle, NULL);
+
+    if (ctx->canvas) {
+        document->tile_count = ctx->canvas->tiles_x * ctx->canvas->tiles_y;
+        document->saved_tiles = calloc(document->tile_count, sizeof(CanvasTile *));
+    }
+    document->path = malloc(strlen(path) + 1);
+    if (!document->path || !document->saved_tiles) {
+        log_error("Failed to set up document %s", path);
+        document->disabled = true;
+        return false;
+    }
+    strcpy(document->path, path);
+
+    if (!load_document(document, ctx)) {
+        document->disabled = true;
+        return false;
+    }
+    return true;
+}
+
+bool open_document(Document *document, const char *path, PaintContext *ctx, const Config *config) {
+    if (!init_document(document, path, ctx, false))
+        return false;
+
+    document->sync_ms = config->autosave_sync_ms;
+    document->checkpoint_entries = config->autosave_checkpoint_entries;
+    document->checkpoint_ms = (Uint32)config->autosave_checkpoint_seconds * 1000;
+    int recovered = config->autosave_enabled ? open_journal(document, ctx) : 0;
+
+    if (pthread_create(&document->worker, NULL, save_worker, document) != 0) {
+        log_error("Failed to start the save thread for %s", path);
+        document->disabled = true;
+        return true;
+    }
+    document->worker_running = true;
+
+    if (document->autosave && !remember_logged(document, ctx)) {
+        log_error("Out of memory setting up autosave for %s", path);
+        document->autosave = false;
+    }
+    if (recovered > 0) {
+        log_info("Recovered %d unsaved changes to %s.", recovered, path);
+        save_document(document, ctx);
+    }
+    return true;
+}
+
+bool open_document_read_only(Document *document, const char *path, PaintContext *ctx) {
+    if (!init_document(document, path, ctx, true))
+        return false;
+
+    // Saving stays off; the journal is replayed but left as it is
+    document->disabled = true;
+    int recovered = open_journal(document, ctx);
+    if (recovered > 0)
+        log_info("Replayed %d unsaved changes from the autosave journal of %s.", recovered, path);
+    return true;
+}
+
+void close_document(Document *document) {
+    if (document->worker_running) {
+        pthread_mutex_lock(&document->lock);
+        document->quit = true;
+        pthread_cond_signal(&document->wake);
+        pthread_mutex_unlock(&document->lock);
+        pthread_join(document->worker, NULL);
+    }
+    // Whatever is left pins a context that is gone by now
+    while (document->queue) {
+        SaveJob *job = document->queue;
+        document->queue = job->next;
+        free_save_job(job);
+    }
+    while (document->finished) {
+        SaveJob *job = document->finished;
+        document->finished = job->next;
+        free_save_job(job);
+    }
+
+    // An empty journal means the last save holds everything
+    if (document->wal_fd >= 0) {
+        close(document->wal_fd);
+        if (document->wal_end == 0 && !document->read_only) {
+            char path[512];
+            journal_path(document, path, sizeof(path));
+            unlink(path);
+        }
+    }
+    if (document->fd >= 0)
+        close(document->fd);
+    if (document->map)
+        munmap(document->map, document->map_size);
+    for (int i = 0; i < document->tile_count && document->saved_tiles; i++) {
+        release_tile(document->saved_tiles[i]);
+    }
+    free(document->saved_tiles);
+    free(document->saved_serials);
+    free(document->logged_serials);
+    free(document->path);
+    pthread_mutex_destroy(&document->lock);
+    pthread_cond_destroy(&document->wake);
+    pthread_cond_destroy(&document->idle);
+    *document = (Document){.fd = -1, .wal_fd = -1};
+}
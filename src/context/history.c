@@ -11,12 +11,24 @@ void init_history(History *history) {
     history->capacity = 0;
 }
 
+void free_history_entry(HistoryEntry *entry) {
+    if (!entry)
+        return;
+    free(entry->points);
+    free_point_stream(&entry->stream);
+    if (!entry->mapped) {
+        free(entry->text_data);
+        free(entry->spans);
+    }
+    free_tile_delta(&entry->tiles);
+    *entry = (HistoryEntry){0};
+}
+
 void free_history(History *history) {
     if (!history) 
         return;
     for (int i = 0; i < history->count; i++) {
-        free(history->entries[i].points);
-        free(history->entries[i].text_data);
+        free_history_entry(&history->entries[i]);
     }
     free(history->entries);
     history->entries = NULL;
@@ -24,60 +36,49 @@ void free_history(History *history) {
     history->capacity = 0;
 }
 
-void ensure_history_capacity(History *history) {
-    if (history->count >= history->capacity) {
-        int new_capacity = history->capacity ? history->capacity * 2 : INITIAL_CAPACITY;
-        history->entries = realloc(history->entries, new_capacity * sizeof(HistoryEntry));
-        history->capacity = new_capacity;
-    }
-}
+bool reserve_history(History *history, int count) {
+    if (history->count + count <= history->capacity)
+        return true;
 
-void ensure_entry_capacity(HistoryEntry *entry) {
-    if (entry->count >= entry->capacity) {
-        int new_capacity = entry->capacity ? entry->capacity * 2 : INITIAL_CAPACITY;
-        entry->points = realloc(entry->points, new_capacity * sizeof(Point));
-        entry->capacity = new_capacity;
-    }
+    int new_capacity = history->capacity ? history->capacity * 2 : INITIAL_CAPACITY;
+    while (new_capacity < history->count + count)
+        new_capacity *= 2;
+    HistoryEntry *entries = realloc(history->entries, new_capacity * sizeof(HistoryEntry));
+    if (!entries)
+        return false;
+    history->entries = entries;
+    history->capacity = new_capacity;
+    return true;
 }
 
-void push_history(History *history, HistoryEntry entry) {
-    ensure_history_capacity(history);
-
-    HistoryEntry *target = &history->entries[history->count];
-
-    target->tool = entry.tool;
-    target->count = entry.count;
-    target->capacity = entry.capacity;
+static bool ensure_entry_capacity(HistoryEntry *entry) {
+    if (entry->count < entry->capacity)
+        return true;
 
-    if (entry.count > 0) {
-        target->points = malloc(entry.capacity * sizeof(Point));
-        if (!target->points) {
-            return;
-        }
-        memcpy(target->points, entry.points, entry.count * sizeof(Point));
-    } else {
-        target->points = NULL;
-    }
+    int new_capacity = entry->capacity ? entry->capacity * 2 : INITIAL_CAPACITY;
+    Point *points = realloc(entry->points, new_capacity * sizeof(Point));
+    if (!points)
+        return false;
+    entry->points = points;
+    entry->capacity = new_capacity;
+    return true;
+}
 
-    if (entry.text_data) {
-        target->text_data = malloc(strlen(entry.text_data) + 1);
-        if (target->text_data) {
-            strcpy(target->text_data, entry.text_data);
-        }
-    } else {
-        target->text_data = NULL;
-    }
+bool push_history(History *history, HistoryEntry *entry) {
+    if (!reserve_history(history, 1))
+        return false;
 
-    history->count++;
+    history->entries[history->count++] = *entry;
+    *entry = (HistoryEntry){0};
+    return true;
 }
 
-HistoryEntry pop_history(History *history) {
-    if (history->count == 0) {
-        HistoryEntry empty = {0};
-        return empty;
-    }
-    HistoryEntry entry = history->entries[--history->count];
-    return entry;
+bool pop_history(History *history, HistoryEntry *entry) {
+    if (history->count == 0)
+        return false;
+
+    *entry = history->entries[--history->count];
+    return true;
 }
 
 bool is_history_empty(const History *history) {
@@ -85,11 +86,22 @@ bool is_history_empty(const History *history) {
 }
 
 bool add_point_to_entry(HistoryEntry *entry, int x, int y) {
-    if (!entry) 
+    if (!entry || !ensure_entry_capacity(entry))
         return false;
-    ensure_entry_capacity(entry);
     entry->points[entry->count].x = x;
     entry->points[entry->count].y = y;
     entry->count++;
     return true;
 }
+
+bool add_spans_to_entry(HistoryEntry *entry, const Span *spans, int count) {
+    if (!entry || count <= 0)
+        return false;
+    Span *grown = realloc(entry->spans, (entry->span_count + count) * sizeof(Span));
+    if (!grown)
+        return false;
+    memcpy(grown + entry->span_count, spans, count * sizeof(Span));
+    entry->spans = grown;
+    entry->span_count += count;
+    return true;
+}
@@ -0,0 +1,164 @@
+#define _POSIX_C_SOURCE 200809L
+#include "context/journal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "context/logs.h"
+
+// Records start on this boundary so spans can be read in place
+#define RECORD_ALIGN 8
+
+void init_journal(HistoryJournal *journal, size_t budget) {
+    journal->fd = -1;
+    journal->map = NULL;
+    journal->size = 0;
+    journal->resident = 0;
+    journal->budget = budget;
+    journal->cursor = 0;
+    journal->failed = false;
+}
+
+void free_journal(HistoryJournal *journal) {
+    if (journal->map)
+        munmap(journal->map, JOURNAL_MAX_SIZE);
+    if (journal->fd >= 0)
+        close(journal->fd);
+    init_journal(journal, journal->budget);
+}
+
+// Creates the backing file in the temporary directory. It is unlinked right
+// away, so it disappears with the process however that ends.
+static bool open_journal(HistoryJournal *journal) {
+    const char *dir = getenv("TMPDIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/mobpaint-journal-XXXXXX", dir && *dir ? dir : "/tmp");
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        log_error("Failed to create history journal %s: %s", path, strerror(errno));
+        return false;
+    }
+    unlink(path);
+
+    void *map = mmap(NULL, JOURNAL_MAX_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        log_error("Failed to map history journal: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    journal->fd = fd;
+    journal->map = map;
+    return true;
+}
+
+static bool write_all(int fd, const void *data, size_t size, off_t offset) {
+    const Uint8 *bytes = data;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += written;
+        size -= (size_t)written;
+        offset += written;
+    }
+    return true;
+}
+
+static size_t align_record(size_t offset) {
+    return (offset + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+size_t entry_resident_size(const HistoryEntry *entry) {
+    if (entry->mapped)
+        return 0;
+    size_t size = entry->stream.size + (size_t)entry->span_count * sizeof(Span);
+    if (entry->text_data)
+        size += strlen(entry->text_data) + 1;
+    return size;
+}
+
+// Appends an entry's replay data to the journal and repoints the entry at the
+// mapped copy, freeing the in-memory one.
+static bool spill_entry(HistoryJournal *journal, HistoryEntry *entry) {
+    size_t spans_size = (size_t)entry->span_count * sizeof(Span);
+    size_t text_size = entry->text_data ? strlen(entry->text_data) + 1 : 0;
+
+    size_t stream_offset = align_record(journal->size);
+    size_t spans_offset = align_record(stream_offset + entry->stream.size);
+    size_t text_offset = spans_offset + spans_size;
+    size_t end = text_offset + text_size;
+    if (end > JOURNAL_MAX_SIZE)
+        return false;
+
+    if (!write_all(journal->fd, entry->stream.data, entry->stream.size, (off_t)stream_offset) ||
+        !write_all(journal->fd, entry->spans, spans_size, (off_t)spans_offset) ||
+        !write_all(journal->fd, entry->text_data, text_size, (off_t)text_offset)) {
+        log_error("Failed to write history journal: %s", strerror(errno));
+        return false;
+    }
+    journal->size = end;
+
+    PointStream stream = entry->stream;
+    free_point_stream(&entry->stream);
+    entry->stream = (PointStream){journal->map + stream_offset, stream.size, stream.count, NULL};
+
+    free(entry->spans);
+    entry->spans = spans_size ? (Span *)(void *)(journal->map + spans_offset) : NULL;
+    free(entry->text_data);
+    entry->text_data = text_size ? (char *)(journal->map + text_offset) : NULL;
+
+    entry->mapped = true;
+    return true;
+}
+
+void journal_forget(HistoryJournal *journal, const History *history) {
+    for (int i = 0; i < history->count; i++) {
+        size_t size = entry_resident_size(&history->entries[i]);
+        journal->resident -= SDL_min(size, journal->resident);
+    }
+}
+
+void journal_commit(HistoryJournal *journal, History *undo_stack, bool spill) {
+    if (undo_stack->count == 0)
+        return;
+    journal->resident += entry_resident_size(&undo_stack->entries[undo_stack->count - 1]);
+    // The new entry may sit below the cursor; it has not been journaled
+    journal->cursor = SDL_min(journal->cursor, undo_stack->count - 1);
+    if (spill)
+        journal_spill(journal, undo_stack);
+}
+
+void journal_spill(HistoryJournal *journal, History *undo_stack) {
+    if (undo_stack->count == 0 || journal->budget == 0 || journal->resident <= journal->budget || journal->failed)
+        return;
+
+    if (journal->fd < 0 && !open_journal(journal)) {
+        journal->failed = true;
+        return;
+    }
+
+    // Oldest entries go first; the ones below the cursor already went. Redo
+    // puts entries back where they were, so only new strokes can land below
+    // the cursor, and journal_commit() moves it down to them.
+    int i = SDL_min(journal->cursor, undo_stack->count);
+    for (; i < undo_stack->count && journal->resident > journal->budget; i++) {
+        HistoryEntry *entry = &undo_stack->entries[i];
+        size_t size = entry_resident_size(entry);
+        if (size == 0)
+            continue;
+        if (!spill_entry(journal, entry)) {
+            journal->failed = true;
+            break;
+        }
+        journal->resident -= size;
+    }
+    journal->cursor = i;
+}
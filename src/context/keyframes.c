@@ -0,0 +1,192 @@
+#include "context/keyframes.h"
+#include <stdlib.h>
+#include <string.h>
+#include "context/logs.h"
+
+#define INITIAL_CAPACITY 8
+
+static inline long absl(long v) {
+    return v < 0 ? -v : v;
+}
+
+// Rough number of pixels apply_history_entry() writes for an entry
+static long entry_replay_cost(const HistoryEntry *entry) {
+    long size = entry->tool.size > 0 ? entry->tool.size : 1;
+    long cost = 0;
+
+    switch (entry->tool.type) {
+    case TOOL_FILL:
+        for (int i = 0; i < entry->span_count; i++) {
+            cost += entry->spans[i].x2 - entry->spans[i].x1 + 1;
+        }
+        return cost;
+    case TOOL_CLEAR:
+        return 0;   // Every tile shares one solid tile
+    case TOOL_TEXT:
+        if (entry->text_data)
+            cost = (long)strlen(entry->text_data) * (size + 12) * (size + 12);
+        return cost;
+    default:
+        break;
+    }
+
+    PointReader reader;
+    Point last, curr;
+    init_point_reader(&reader, &entry->stream);
+    if (!read_point(&reader, &last))
+        return 0;
+
+    while (read_point(&reader, &curr)) {
+        long distance = absl(curr.x - last.x) + absl(curr.y - last.y);
+        cost += entry->tool.type == TOOL_CIRCLE ? 7 * distance * size : distance;
+        last = curr;
+    }
+    return entry->tool.type == TOOL_CIRCLE ? cost : (cost + 1) * size * size;
+}
+
+// Tiles a snapshot keeps alive that the previous keyframe does not
+static size_t keyframe_memory(const Keyframe *keyframe, const Keyframe *previous) {
+    const Canvas *snapshot = keyframe->snapshot;
+    size_t tiles = 0;
+    for (int i = 0; i < snapshot->tiles_x * snapshot->tiles_y; i++) {
+        if (snapshot->tiles[i] != previous->snapshot->tiles[i])
+            tiles++;
+    }
+    return tiles * sizeof(CanvasTile);
+}
+
+static bool add_keyframe(KeyframeCache *cache, const Canvas *canvas, int position) {
+    if (cache->count >= cache->capacity) {
+        int new_capacity = cache->capacity ? cache->capacity * 2 : INITIAL_CAPACITY;
+        Keyframe *frames = realloc(cache->frames, new_capacity * sizeof(Keyframe));
+        if (!frames)
+            return false;
+        cache->frames = frames;
+        cache->capacity = new_capacity;
+    }
+
+    Canvas *snapshot = create_canvas(canvas->width, canvas->height);
+    if (!snapshot)
+        return false;
+    canvas_copy(snapshot, canvas);
+
+    // The first keyframe is never dropped, so its tiles are not counted
+    Keyframe *keyframe = &cache->frames[cache->count++];
+    *keyframe = (Keyframe){position, snapshot, 0};
+    if (cache->count > 1)
+        keyframe->memory = keyframe_memory(keyframe, keyframe - 1);
+    cache->memory += keyframe->memory;
+    return true;
+}
+
+// Removes a keyframe other than the first; the one after it is then
+// counted against the keyframe before it.
+static void remove_keyframe(KeyframeCache *cache, int index) {
+    cache->memory -= cache->frames[index].memory;
+    free_canvas(cache->frames[index].snapshot);
+    memmove(&cache->frames[index], &cache->frames[index + 1],
+            (cache->count - index - 1) * sizeof(Keyframe));
+    cache->count--;
+
+    if (index < cache->count) {
+        Keyframe *next = &cache->frames[index];
+        cache->memory -= next->memory;
+        next->memory = keyframe_memory(next, next - 1);
+        cache->memory += next->memory;
+    }
+}
+
+// Keyframe whose removal leaves the smallest replay gap. The blank keyframe
+// is never picked so every position stays reachable.
+static int cheapest_keyframe(const KeyframeCache *cache, int history_count) {
+    int best = -1;
+    int best_gap = 0;
+    for (int i = 1; i < cache->count; i++) {
+        int next = i + 1 < cache->count ? cache->frames[i + 1].position : history_count;
+        int gap = next - cache->frames[i - 1].position;
+        if (best < 0 || gap < best_gap) {
+            best = i;
+            best_gap = gap;
+        }
+    }
+    return best;
+}
+
+bool init_keyframes(KeyframeCache *cache, const Canvas *blank, size_t memory_budget) {
+    cache->frames = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->replay_cost = 0;
+    cache->memory = 0;
+    cache->evicted = 0;
+    cache->memory_budget = memory_budget;
+    return blank && add_keyframe(cache, blank, 0);
+}
+
+void free_keyframes(KeyframeCache *cache) {
+    if (!cache)
+        return;
+    for (int i = 0; i < cache->count; i++) {
+        free_canvas(cache->frames[i].snapshot);
+    }
+    free(cache->frames);
+    cache->frames = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+    cache->replay_cost = 0;
+    cache->memory = 0;
+    cache->evicted = 0;
+}
+
+void keyframes_truncate(KeyframeCache *cache, int position, const History *discarded) {
+    while (cache->count > 1 && cache->frames[cache->count - 1].position > position) {
+        remove_keyframe(cache, cache->count - 1);
+    }
+    for (int i = 0; discarded && i < discarded->count; i++) {
+        size_t freed = tile_delta_memory(&discarded->entries[i].tiles);
+        cache->memory = cache->memory > freed ? cache->memory - freed : 0;
+    }
+}
+
+void keyframes_commit(KeyframeCache *cache, const Canvas *canvas, History *undo_stack) {
+    if (!cache || !canvas || !undo_stack || undo_stack->count == 0)
+        return;
+
+    const HistoryEntry *entry = &undo_stack->entries[undo_stack->count - 1];
+    cache->memory += tile_delta_memory(&entry->tiles);
+    cache->replay_cost += entry_replay_cost(entry);
+    if (cache->replay_cost >= KEYFRAME_REPLAY_COST) {
+        if (add_keyframe(cache, canvas, undo_stack->count))
+            cache->replay_cost = 0;
+        else
+            log_error("Failed to allocate history keyframe");
+    }
+
+    // Oldest deltas go first; the newest entry keeps its delta so the most
+    // common undo stays a tile swap. Undo and redo move entries above the
+    // evicted ones only, so the scan resumes where the last one stopped.
+    cache->evicted = SDL_min(cache->evicted, undo_stack->count - 1);
+    for (; cache->evicted < undo_stack->count - 1 && cache->memory > cache->memory_budget; cache->evicted++) {
+        TileDelta *delta = &undo_stack->entries[cache->evicted].tiles;
+        if (delta->evicted)
+            continue;
+        size_t freed = tile_delta_memory(delta);
+        cache->memory = cache->memory > freed ? cache->memory - freed : 0;
+        evict_tile_delta(delta);
+    }
+
+    while (cache->memory > cache->memory_budget) {
+        int index = cheapest_keyframe(cache, undo_stack->count);
+        if (index < 0)
+            break;
+        remove_keyframe(cache, index);
+    }
+}
+
+const Keyframe *find_keyframe(const KeyframeCache *cache, int position) {
+    const Keyframe *best = NULL;
+    for (int i = 0; i < cache->count && cache->frames[i].position <= position; i++) {
+        best = &cache->frames[i];
+    }
+    return best;
+}
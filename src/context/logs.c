@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include "context/logs.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +10,8 @@
 #include <dirent.h>
 #include <sys/types.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <SDL2/SDL.h>
 
 #ifndef LOG_DIR
 #define LOG_DIR "logs/"
@@ -20,8 +23,58 @@
 
 #define MAX_HISTORY_FILES 100
 
-static FILE *error_log = NULL;
-static FILE *history_log = NULL;
+// Messages waiting for the writer thread; a power of two
+#define LOG_RING_SIZE 1024
+
+// Longest message kept, terminator included; longer ones are cut short
+#define LOG_RECORD_SIZE 512
+
+// Longest the writer sleeps before looking at the ring anyway
+#define LOG_IDLE_MS 250
+
+// Buffer of each log file, so a batch goes out in one write
+#define LOG_FILE_BUFFER (64 * 1024)
+
+typedef enum {
+    LOG_ERROR,
+    LOG_INFO,
+    LOG_TARGET_COUNT
+} LogTarget;
+
+// Where messages go: queued for the writer thread, or written on the
+// calling thread if the writer could not be started.
+typedef enum {
+    LOGS_CLOSED,
+    LOGS_QUEUED,
+    LOGS_DIRECT
+} LogsState;
+
+// A formatted message in the ring. The slot's sequence number says whose
+// turn it is: producers claim slot i when it equals i, publish it by
+// setting i + 1, and the writer hands it back for the next lap with
+// i + LOG_RING_SIZE. Nothing blocks; a producer that finds the ring full
+// drops its message and counts it.
+typedef struct {
+    SDL_atomic_t sequence;
+    LogTarget target;
+    time_t time;
+    char text[LOG_RECORD_SIZE];
+} LogRecord;
+
+static FILE *log_files[LOG_TARGET_COUNT] = {NULL, NULL};
+static const char *const log_prefixes[LOG_TARGET_COUNT] = {"ERROR", "INFO"};
+
+static SDL_atomic_t logs_state;
+static pthread_mutex_t direct_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static LogRecord ring[LOG_RING_SIZE];
+static SDL_atomic_t ring_tail;                      // Next sequence producers claim
+static unsigned ring_head = 0;                      // Next sequence the writer reads (writer only)
+static SDL_atomic_t dropped[LOG_TARGET_COUNT];      // Messages lost to a full ring since last reported
+
+static pthread_t writer;
+static sem_t writer_wake;                           // Posted for every queued message and on close
+static SDL_atomic_t writer_quit;
 
 typedef struct {
     char path[256];
@@ -34,17 +87,17 @@ static int compare_by_mtime(const void *a, const void *b) {
     return (int)(la->mtime - lb->mtime);
 }
 
-static void* rotate_logs_thread(void *arg) {
-    (void)arg;
+// Keeps the three most recent history logs
+static void rotate_logs(void) {
     DIR *dir = opendir(LOG_DIR);
     if (!dir)
-        return NULL;
+        return;
 
     LogEntry entries[MAX_HISTORY_FILES];
     int count = 0;
 
     struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
+    while ((entry = readdir(dir)) != NULL && count < MAX_HISTORY_FILES) {
         if (!strstr(entry->d_name, "-history.log"))
             continue;
 
@@ -53,7 +106,7 @@ static void* rotate_logs_thread(void *arg) {
 
         struct stat st;
         if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode)) {
-            strncpy(entries[count].path, fullpath, sizeof(entries[count].path));
+            snprintf(entries[count].path, sizeof(entries[count].path), "%s", fullpath);
             entries[count].mtime = st.st_mtime;
             count++;
         }
@@ -62,15 +115,13 @@ static void* rotate_logs_thread(void *arg) {
     closedir(dir);
 
     if (count <= 3)
-        return NULL;
+        return;
 
     qsort(entries, count, sizeof(LogEntry), compare_by_mtime);
 
     for (int i = 0; i < count - 3; ++i) {
         remove(entries[i].path);
     }
-
-    return NULL;
 }
 
 static void get_date_string(char *buffer, size_t size) {
@@ -79,6 +130,101 @@ static void get_date_string(char *buffer, size_t size) {
     strftime(buffer, size, "%Y-%m-%d", t);
 }
 
+// Writes one line. Only the writer thread, or a caller holding
+// direct_lock, may call this.
+static void write_line(LogTarget target, time_t time, const char *text) {
+    static time_t formatted = (time_t)-1;
+    static char timebuf[20];
+
+    if (time != formatted) {
+        struct tm t;
+        localtime_r(&time, &t);
+        strftime(timebuf, sizeof(timebuf), "%H:%M:%S", &t);
+        formatted = time;
+    }
+    fprintf(log_files[target], "[%s] %s: %s\n", timebuf, log_prefixes[target], text);
+}
+
+// Writes everything published so far, then a line for any messages that
+// were dropped, with one flush per file for the whole batch.
+static void drain_ring(void) {
+    bool wrote[LOG_TARGET_COUNT] = {false, false};
+
+    for (;;) {
+        LogRecord *record = &ring[ring_head % LOG_RING_SIZE];
+        if ((unsigned)SDL_AtomicGet(&record->sequence) != ring_head + 1)
+            break;
+        write_line(record->target, record->time, record->text);
+        wrote[record->target] = true;
+        SDL_AtomicSet(&record->sequence, (int)(ring_head + LOG_RING_SIZE));
+        ring_head++;
+    }
+
+    for (int target = 0; target < LOG_TARGET_COUNT; target++) {
+        int lost = SDL_AtomicSet(&dropped[target], 0);
+        if (lost > 0) {
+            char text[64];
+            snprintf(text, sizeof(text), "%d log messages dropped, log queue full", lost);
+            write_line(target, time(NULL), text);
+            wrote[target] = true;
+        }
+        if (wrote[target])
+            fflush(log_files[target]);
+    }
+}
+
+// Sleeps until a message is queued, close_logs() is called or the idle
+// interval passes.
+static void wait_for_messages(void) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)LOG_IDLE_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while (sem_timedwait(&writer_wake, &deadline) != 0 && errno == EINTR)
+        ;
+}
+
+static void *log_writer(void *arg) {
+    (void)arg;
+    rotate_logs();
+
+    for (;;) {
+        // Whatever was queued before close_logs() is drained first
+        bool quit = SDL_AtomicGet(&writer_quit);
+        drain_ring();
+        if (quit)
+            break;
+        wait_for_messages();
+    }
+    return NULL;
+}
+
+// Claims a ring slot, formats the message into it and publishes it.
+static void queue_message(LogTarget target, const char *format, va_list args) {
+    unsigned position = (unsigned)SDL_AtomicGet(&ring_tail);
+    LogRecord *record;
+    for (;;) {
+        record = &ring[position % LOG_RING_SIZE];
+        int lap = (int)((unsigned)SDL_AtomicGet(&record->sequence) - position);
+        if (lap == 0) {
+            if (SDL_AtomicCAS(&ring_tail, (int)position, (int)(position + 1)))
+                break;
+        } else if (lap < 0) {
+            // The writer has not emptied this slot yet: the ring is full
+            SDL_AtomicIncRef(&dropped[target]);
+            return;
+        }
+        position = (unsigned)SDL_AtomicGet(&ring_tail);
+    }
+
+    record->target = target;
+    record->time = time(NULL);
+    vsnprintf(record->text, sizeof(record->text), format, args);
+    SDL_AtomicSet(&record->sequence, (int)(position + 1));
+    sem_post(&writer_wake);
+}
+
 bool init_logs(void) {
     struct stat st = {0};
     if (stat(LOG_DIR, &st) == -1) {
@@ -88,7 +234,7 @@ bool init_logs(void) {
         }
     }
 
-    error_log = fopen(ERROR_LOG_PATH, "a");
+    FILE *error_log = fopen(ERROR_LOG_PATH, "a");
     if (!error_log) {
         fprintf(stderr, "Failed to open errors.log\n");
         return false;
@@ -99,61 +245,89 @@ bool init_logs(void) {
     char history_path[128];
     snprintf(history_path, sizeof(history_path), "%s%s-history.log", LOG_DIR, date);
 
-    history_log = fopen(history_path, "a");
+    FILE *history_log = fopen(history_path, "a");
     if (!history_log) {
         fprintf(stderr, "Failed to open history log file\n");
         fclose(error_log);
         return false;
     }
+    setvbuf(error_log, NULL, _IOFBF, LOG_FILE_BUFFER);
+    setvbuf(history_log, NULL, _IOFBF, LOG_FILE_BUFFER);
+    log_files[LOG_ERROR] = error_log;
+    log_files[LOG_INFO] = history_log;
 
     fprintf(history_log, "[START] MobPaint session started.\n");
     fflush(history_log);
 
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, rotate_logs_thread, NULL) == 0) {
-        pthread_detach(tid);
+    for (unsigned i = 0; i < LOG_RING_SIZE; i++)
+        SDL_AtomicSet(&ring[i].sequence, (int)i);
+    SDL_AtomicSet(&ring_tail, 0);
+    ring_head = 0;
+    SDL_AtomicSet(&writer_quit, 0);
+
+    // Without the writer thread messages are written where they are logged
+    if (sem_init(&writer_wake, 0, 0) == 0 && pthread_create(&writer, NULL, log_writer, NULL) == 0) {
+        SDL_AtomicSet(&logs_state, LOGS_QUEUED);
+    } else {
+        fprintf(stderr, "Failed to start the log writer; logging synchronously\n");
+        rotate_logs();
+        SDL_AtomicSet(&logs_state, LOGS_DIRECT);
     }
 
     return true;
 }
 
 void close_logs(void) {
-    if (history_log) {
-        fprintf(history_log, "[END] MobPaint session ended.\n");
-        fclose(history_log);
-        history_log = NULL;
+    int state = SDL_AtomicSet(&logs_state, LOGS_CLOSED);
+    if (state == LOGS_QUEUED) {
+        SDL_AtomicSet(&writer_quit, 1);
+        sem_post(&writer_wake);
+        pthread_join(writer, NULL);
+        sem_destroy(&writer_wake);
     }
-    if (error_log) {
-        fclose(error_log);
-        error_log = NULL;
+
+    pthread_mutex_lock(&direct_lock);
+    if (log_files[LOG_INFO]) {
+        fprintf(log_files[LOG_INFO], "[END] MobPaint session ended.\n");
+        fclose(log_files[LOG_INFO]);
+        log_files[LOG_INFO] = NULL;
+    }
+    if (log_files[LOG_ERROR]) {
+        fclose(log_files[LOG_ERROR]);
+        log_files[LOG_ERROR] = NULL;
     }
+    pthread_mutex_unlock(&direct_lock);
 }
 
-static void vlog(FILE *log_file, const char *prefix, const char *format, va_list args) {
-    if (!log_file) return;
-
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-
-    char timebuf[20];
-    strftime(timebuf, sizeof(timebuf), "%H:%M:%S", t);
+static void vlog(LogTarget target, const char *format, va_list args) {
+    int state = SDL_AtomicGet(&logs_state);
+    if (state == LOGS_QUEUED) {
+        queue_message(target, format, args);
+        return;
+    }
+    if (state != LOGS_DIRECT)
+        return;
 
-    fprintf(log_file, "[%s] %s: ", timebuf, prefix);
-    vfprintf(log_file, format, args);
-    fprintf(log_file, "\n");
-    fflush(log_file);
+    char text[LOG_RECORD_SIZE];
+    vsnprintf(text, sizeof(text), format, args);
+    pthread_mutex_lock(&direct_lock);
+    if (log_files[target]) {
+        write_line(target, time(NULL), text);
+        fflush(log_files[target]);
+    }
+    pthread_mutex_unlock(&direct_lock);
 }
 
 void log_error(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    vlog(error_log, "ERROR", format, args);
+    vlog(LOG_ERROR, format, args);
     va_end(args);
 }
 
 void log_info(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    vlog(history_log, "INFO", format, args);
+    vlog(LOG_INFO, format, args);
     va_end(args);
 }
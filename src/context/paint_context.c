@@ -2,23 +2,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-
-void apply_history_entry(SDL_Renderer *renderer, const HistoryEntry *entry);
-
-static HistoryEntry* create_empty_entry(Tool tool) {
-    HistoryEntry *entry = malloc(sizeof(HistoryEntry));
-    if (!entry) return NULL;
-    entry->points = NULL;
-    entry->count = 0;
-    entry->capacity = 0;
-    entry->text_data = NULL;
-    
-    entry->tool.type = tool.type;
-    entry->tool.size = tool.size;
-    entry->tool.color = tool.color;
-
-    return entry;
-}
+#include "context/logs.h"
+#include "context/profile.h"
+#include "context/replay.h"
 
 void init_paint_context(SDL_Renderer *renderer, PaintContext *paint_context, Config* config, Tool current_tool) {
     if (!paint_context) return;
@@ -27,7 +13,6 @@ void init_paint_context(SDL_Renderer *renderer, PaintContext *paint_context, Con
     paint_context->current_tool = current_tool;
     paint_context->mouse_x = -1;
     paint_context->mouse_y = -1;
-    paint_context->committed_stroke_count = 0;
 
     paint_context->text_input_active = false;
     paint_context->text_input_buffer[0] = '\0';
@@ -38,70 +23,230 @@ void init_paint_context(SDL_Renderer *renderer, PaintContext *paint_context, Con
     paint_context->undo_stack = malloc(sizeof(History));
     paint_context->redo_stack = malloc(sizeof(History));
     paint_context->current_stroke = NULL;
+    paint_context->stroke = (HistoryEntry){0};
+    init_point_pool(&paint_context->point_pool);
+    init_journal(&paint_context->journal, (size_t)config->history_resident_budget_mb * 1024 * 1024);
+    paint_context->next_serial = 1;
+    paint_context->history_version = 0;
+    paint_context->history_pins = 0;
+    init_history(&paint_context->retired);
+    paint_context->dedup_points = config->history_dedup_points;
+    paint_context->simplify_tolerance = config->history_simplify_tolerance;
+    paint_context->replay_threads = config->history_replay_threads;
 
     if (paint_context->undo_stack) init_history(paint_context->undo_stack);
     if (paint_context->redo_stack) init_history(paint_context->redo_stack);
 
-    paint_context->bitmap_cache = SDL_CreateTexture(
-        renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
-        config->window_width, config->window_height
-    );
-
-    if (paint_context->bitmap_cache) {
-        SDL_SetRenderTarget(renderer, paint_context->bitmap_cache);
-        SDL_SetRenderDrawColor(renderer, config->default_background_color.r,
-                                          config->default_background_color.g,
-                                          config->default_background_color.b,
-                                          config->default_background_color.a);
-        SDL_RenderClear(renderer);
-        SDL_SetRenderTarget(renderer, NULL);
+    paint_context->background = canvas_map_color(config->default_background_color);
+
+    paint_context->canvas = create_canvas(config->window_width, config->window_height);
+    if (!paint_context->canvas) {
+        log_error("Failed to allocate %dx%d canvas", config->window_width, config->window_height);
+        init_keyframes(&paint_context->keyframes, NULL, 0);
+        return;
     }
+    canvas_clear(paint_context->canvas, paint_context->background);
+
+    size_t budget = (size_t)config->history_memory_budget_mb * 1024 * 1024;
+    if (!init_keyframes(&paint_context->keyframes, paint_context->canvas, budget))
+        log_error("Failed to allocate the initial history keyframe");
 }
 
 void start_stroke(PaintContext *paint_context) {
     if (!paint_context) return;
-    paint_context->current_stroke = create_empty_entry(paint_context->current_tool);
+    if (paint_context->current_stroke)
+        end_stroke(paint_context);
+
+    // The stroke lives in the context; only its point buffer carries over
+    // from the previous one.
+    HistoryEntry *stroke = &paint_context->stroke;
+    *stroke = (HistoryEntry){
+        .points = stroke->points,
+        .capacity = stroke->capacity,
+        .tool = paint_context->current_tool,
+    };
+    init_tile_delta(&stroke->tiles);
+
+    paint_context->current_stroke = stroke;
+    canvas_begin_recording(paint_context->canvas, &stroke->tiles);
+    // The stroke is drawn in pieces as input arrives; each pixel is blended
+    // once, as when the finished stroke is replayed.
+    if (!canvas_begin_coverage(paint_context->canvas))
+        log_error("Failed to allocate the stroke coverage bitmap");
 }
 
 void add_point_to_current_stroke(PaintContext *paint_context, int x, int y) {
-    if (!paint_context || !paint_context->current_stroke) return;
+    Point point = {x, y};
+    add_points_to_current_stroke(paint_context, &point, 1);
+}
 
-    if (paint_context->current_stroke->count >= paint_context->current_stroke->capacity) {
-        int new_capacity = paint_context->current_stroke->capacity ? paint_context->current_stroke->capacity * 2 : 8;
-        Point *new_points = realloc(paint_context->current_stroke->points, new_capacity * sizeof(Point));
-        if (!new_points) return;
-        paint_context->current_stroke->points = new_points;
-        paint_context->current_stroke->capacity = new_capacity;
+bool add_points_to_current_stroke(PaintContext *paint_context, const Point *points, int count) {
+    if (!paint_context || !paint_context->current_stroke || count <= 0) return false;
+
+    HistoryEntry *stroke = paint_context->current_stroke;
+    if (stroke->count + count > stroke->capacity) {
+        int new_capacity = stroke->capacity ? stroke->capacity : 8;
+        while (new_capacity < stroke->count + count)
+            new_capacity *= 2;
+        Point *new_points = realloc(stroke->points, new_capacity * sizeof(Point));
+        if (!new_points) return false;
+        stroke->points = new_points;
+        stroke->capacity = new_capacity;
     }
 
-    paint_context->current_stroke->points[paint_context->current_stroke->count++] = (Point){x, y};
+    memcpy(stroke->points + stroke->count, points, count * sizeof(Point));
+    stroke->count += count;
+    return true;
+}
+
+// Compacts a finished stroke's points and encodes them into the pool.
+// Dedup and simplification only apply to freehand strokes; line and circle
+// entries need their two points as they are.
+static bool encode_stroke(PaintContext *paint_context, HistoryEntry *stroke) {
+    if (stroke->tool.type == TOOL_BRUSH || stroke->tool.type == TOOL_ERASER) {
+        if (paint_context->dedup_points)
+            stroke->count = dedup_points(stroke->points, stroke->count);
+        stroke->count = simplify_points(stroke->points, stroke->count, paint_context->simplify_tolerance);
+    }
+
+    if (!encode_points(&stroke->stream, &paint_context->point_pool, stroke->points, stroke->count)) {
+        log_error("Failed to encode %d stroke points; the stroke was undone", stroke->count);
+        stroke->count = 0;
+        return false;
+    }
+    return true;
+}
+
+// Frees the redo history, or sets its entries aside while a save may still
+// be reading them. Their tile deltas go right away; saves do not read those.
+static void discard_redo(PaintContext *paint_context) {
+    History *redo = paint_context->redo_stack;
+    if (paint_context->history_pins == 0 || redo->count == 0) {
+        free_history(redo);
+        init_history(redo);
+        return;
+    }
+
+    for (int i = 0; i < redo->count; i++) {
+        free_tile_delta(&redo->entries[i].tiles);
+    }
+    History *retired = &paint_context->retired;
+    if (retired->count == 0) {
+        free(retired->entries);
+        *retired = *redo;
+    } else if (reserve_history(retired, redo->count)) {
+        memcpy(retired->entries + retired->count, redo->entries, redo->count * sizeof(HistoryEntry));
+        retired->count += redo->count;
+        free(redo->entries);
+    } else {
+        // Leaked rather than freed under a save that may read them
+        log_error("Failed to set aside %d discarded history entries", redo->count);
+        free(redo->entries);
+    }
+    init_history(redo);
+}
+
+// Pushes a finished entry onto the undo history, which discards the redo
+// history, and lets the keyframes and the journal account for it. Nothing
+// changes if the push fails; the caller still owns the entry then.
+static bool commit_entry(PaintContext *paint_context, HistoryEntry *entry) {
+    entry->serial = paint_context->next_serial;
+    if (!push_history(paint_context->undo_stack, entry)) {
+        log_error("Failed to grow the undo history");
+        return false;
+    }
+    paint_context->next_serial++;
+
+    keyframes_truncate(&paint_context->keyframes, paint_context->undo_stack->count - 1, paint_context->redo_stack);
+    journal_forget(&paint_context->journal, paint_context->redo_stack);
+    discard_redo(paint_context);
+    keyframes_commit(&paint_context->keyframes, paint_context->canvas, paint_context->undo_stack);
+    journal_commit(&paint_context->journal, paint_context->undo_stack, paint_context->history_pins == 0);
+    paint_context->history_version++;
+    return true;
 }
 
 void end_stroke(PaintContext *paint_context) {
     if (!paint_context || !paint_context->current_stroke) return;
 
-    if (paint_context->current_stroke->count > 0) {
-        push_history(paint_context->undo_stack, *(paint_context->current_stroke));
-        free_history(paint_context->redo_stack);
-        init_history(paint_context->redo_stack);
+    HistoryEntry *stroke = paint_context->current_stroke;
+    canvas_end_recording(paint_context->canvas);
+    canvas_end_coverage(paint_context->canvas);
+    // A stroke that cannot be stored cannot be undone or saved either, so
+    // its pixels come back off the canvas.
+    if (!encode_stroke(paint_context, stroke))
+        canvas_apply_delta(paint_context->canvas, &stroke->tiles, true);
+
+    // Keep the raw point buffer for the next stroke instead of moving it
+    // into the history.
+    Point *points = stroke->points;
+    int capacity = stroke->capacity;
+    stroke->points = NULL;
+    stroke->capacity = 0;
+
+    if (stroke->count > 0 && !commit_entry(paint_context, stroke))
+        canvas_apply_delta(paint_context->canvas, &stroke->tiles, true);
+    free_history_entry(stroke);
+
+    stroke->points = points;
+    stroke->capacity = capacity;
+    paint_context->current_stroke = NULL;
+}
+
+void cancel_stroke(PaintContext *paint_context) {
+    if (!paint_context || !paint_context->current_stroke) return;
+
+    HistoryEntry *stroke = paint_context->current_stroke;
+    canvas_end_recording(paint_context->canvas);
+    canvas_end_coverage(paint_context->canvas);
+    canvas_apply_delta(paint_context->canvas, &stroke->tiles, true);
 
-        int uncommitted = paint_context->undo_stack->count - paint_context->committed_stroke_count;
-        if (uncommitted >= CACHE_THRESHOLD && paint_context->bitmap_cache) {
-            SDL_SetRenderTarget(paint_context->renderer, paint_context->bitmap_cache);
-            for (int i = paint_context->committed_stroke_count; i < paint_context->undo_stack->count; i++) {
-                apply_history_entry(paint_context->renderer, &paint_context->undo_stack->entries[i]);
-            }
-            paint_context->committed_stroke_count = paint_context->undo_stack->count;
-            SDL_SetRenderTarget(paint_context->renderer, NULL);
-        }
-    }
+    Point *points = stroke->points;
+    int capacity = stroke->capacity;
+    stroke->points = NULL;
+    stroke->capacity = 0;
+    free_history_entry(stroke);
 
-    free(paint_context->current_stroke->points);
-    free(paint_context->current_stroke->text_data);
-    free(paint_context->current_stroke);
+    stroke->points = points;
+    stroke->capacity = capacity;
     paint_context->current_stroke = NULL;
 }
 
+bool commit_history_entry(PaintContext *paint_context, HistoryEntry *entry) {
+    if (!paint_context || !paint_context->canvas || paint_context->current_stroke || entry->count == 0) {
+        free_history_entry(entry);
+        return false;
+    }
+
+    init_tile_delta(&entry->tiles);
+    canvas_begin_recording(paint_context->canvas, &entry->tiles);
+    apply_history_entry(paint_context->canvas, entry);
+    canvas_end_recording(paint_context->canvas);
+
+    bool committed = commit_entry(paint_context, entry);
+    if (!committed)
+        canvas_apply_delta(paint_context->canvas, &entry->tiles, true);
+    free_history_entry(entry);
+    return committed;
+}
+
+bool clear_canvas(PaintContext *paint_context) {
+    // A stroke in progress still owns its drag; clearing under it is refused
+    if (!paint_context || !paint_context->canvas || paint_context->current_stroke) return false;
+
+    // Entries need a point to be replayed and stored; the clear's is unused
+    Point origin = {0, 0};
+    HistoryEntry entry = {
+        .count = 1,
+        .tool = {TOOL_CLEAR, canvas_unmap_color(paint_context->background), 0},
+    };
+    if (!encode_points(&entry.stream, &paint_context->point_pool, &origin, 1)) {
+        log_error("Failed to encode the canvas clear");
+        return false;
+    }
+    return commit_history_entry(paint_context, &entry);
+}
+
 void update_coordinates(PaintContext *paint_context, int x, int y) {
     if (paint_context) {
         paint_context->mouse_x = x;
@@ -115,110 +260,125 @@ void update_tool(PaintContext *paint_context, Tool tool) {
     }
 }
 
-void apply_history_entry(SDL_Renderer *renderer, const HistoryEntry *entry) {
-    if (!renderer || !entry) 
+void apply_history_entry(Canvas *canvas, const HistoryEntry *entry) {
+    if (!canvas || !entry || entry->count == 0) 
         return;
 
-    SDL_SetRenderDrawColor(renderer,
-        entry->tool.color.r,
-        entry->tool.color.g,
-        entry->tool.color.b,
-        entry->tool.color.a);
+    Uint32 color = canvas_map_color(entry->tool.color);
+
+    PointReader reader;
+    Point last, curr;
+    init_point_reader(&reader, &entry->stream);
+    if (!read_point(&reader, &last))
+        return;
 
-    Point *last = &entry->points[0];
-        
     switch (entry->tool.type)
     {
     case TOOL_BRUSH:
     case TOOL_ERASER:
     case TOOL_LINE: {
-        for (int i = 1; i < entry->count; i++) {
-            Point *curr = &entry->points[i];
-            draw_thick_line(renderer, last->x, last->y, curr->x, curr->y, entry->tool.size);
-            last = curr;
-        }
-        break;
+        draw_encoded_polyline(canvas, &entry->stream, entry->tool.size, color);
+        return;
     }
     case TOOL_CIRCLE: {
-        for (int i = 1; i < entry->count; i++) {
-            Point *curr = &entry->points[i];
-            draw_thick_circle(renderer, last->x, last->y, curr->x, curr->y, entry->tool.size);
+        while (read_point(&reader, &curr)) {
+            draw_thick_circle(canvas, last.x, last.y, curr.x, curr.y, entry->tool.size, color);
             last = curr;
         }
         return;
     }
     case TOOL_FILL: {
-        for (int i = 1; i < entry->count; i++) {
-            Point *curr = &entry->points[i];
-            SDL_RenderDrawPoint(renderer, curr->x, curr->y);
-            last = curr;
+        for (int i = 0; i < entry->span_count; i++) {
+            const Span *span = &entry->spans[i];
+            canvas_fill_span(canvas, span->x1, span->x2, span->y, color);
         }
-        break;
+        return;
     }
     case TOOL_TEXT: {
-        if (entry->count > 0 && entry->text_data) {
-            Point *pos = &entry->points[0];
-            
-            TTF_Font *font = TTF_OpenFont("assets/OpenSans.ttf", entry->tool.size + 12);
-            if (font) {
-                extern void render_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color color);
-                render_text(renderer, font, entry->text_data, pos->x, pos->y, entry->tool.color);
-                TTF_CloseFont(font);
-            }
+        if (entry->text_data) {
+            render_text(canvas, get_font_face(entry->tool.size + 12), entry->text_data,
+                        last.x, last.y, entry->tool.color);
         }
         return;
     }
+    case TOOL_CLEAR: {
+        canvas_clear(canvas, color);
+        return;
+    }
     default:
         break;
     }
+}
+
+// Rebuilds the state after the first `position` undo entries
+static void restore_position(PaintContext *ctx, int position) {
+    const Keyframe *keyframe = find_keyframe(&ctx->keyframes, position);
+    int first = 0;
 
-    if (last->x >= 0 && last->y >= 0) {
-        SDL_Rect rect = {
-            .w = entry->tool.size,
-            .h = entry->tool.size,
-            .x = last->x - rect.w / 2,
-            .y = last->y - rect.h / 2,
-        };
-        SDL_RenderFillRect(renderer, &rect);
+    if (keyframe) {
+        canvas_copy(ctx->canvas, keyframe->snapshot);
+        first = keyframe->position;
+    } else {
+        canvas_clear(ctx->canvas, ctx->background);
     }
+
+    replay_history(ctx->canvas, ctx->undo_stack->entries + first, position - first, ctx->replay_threads);
 }
 
 void redraw_canvas(PaintContext *paint_context) {
-    if (!paint_context || !paint_context->renderer) 
+    if (!paint_context || !paint_context->canvas) 
         return;
+    PROFILE_SCOPE("redraw_canvas");
 
-    SDL_SetRenderTarget(paint_context->renderer, NULL);
-    
-    SDL_SetRenderDrawColor(paint_context->renderer, 255, 255, 255, 255);
-    SDL_RenderClear(paint_context->renderer);
-
-    if (paint_context->bitmap_cache && paint_context->committed_stroke_count > 0) {
-        SDL_RenderCopy(paint_context->renderer, paint_context->bitmap_cache, NULL, NULL);
-    }
-
-    for (int i = paint_context->committed_stroke_count; i < paint_context->undo_stack->count; i++) {
-        apply_history_entry(paint_context->renderer, &paint_context->undo_stack->entries[i]);
-    }
+    restore_position(paint_context, paint_context->undo_stack->count);
 }
 
-static bool exchange_history(PaintContext *ctx, History *from, History *to) {
-    if (!from || !to || is_history_empty(from)) return false;
+static bool exchange_history(PaintContext *ctx, History *from, History *to, bool undo) {
+    // Tiles are being recorded for an unfinished stroke; swapping them now
+    // would corrupt its delta.
+    if (!from || !to || is_history_empty(from) || ctx->current_stroke) return false;
 
-    HistoryEntry entry = pop_history(from);
-    push_history(to, entry);
-
-    ctx->committed_stroke_count = 0;
-    
-    redraw_canvas(ctx);
+    // The entry moves between the stacks as is; nothing is copied. Once it
+    // is off `from` it has to land on `to`, so the room is made first.
+    if (!reserve_history(to, 1)) {
+        log_error("Failed to grow the %s history", undo ? "redo" : "undo");
+        return false;
+    }
+    HistoryEntry entry;
+    pop_history(from, &entry);
+    if (!entry.tiles.evicted)
+        canvas_apply_delta(ctx->canvas, &entry.tiles, undo);
+    else if (undo)
+        restore_position(ctx, ctx->undo_stack->count);
+    else
+        apply_history_entry(ctx->canvas, &entry);
+
+    push_history(to, &entry);
+    ctx->history_version++;
     return true;
 }
 
 bool paint_context_undo(PaintContext *paint_context) {
-    return paint_context && exchange_history(paint_context, paint_context->undo_stack, paint_context->redo_stack);
+    return paint_context && exchange_history(paint_context, paint_context->undo_stack, paint_context->redo_stack, true);
 }
 
 bool paint_context_redo(PaintContext *paint_context) {
-    return paint_context && exchange_history(paint_context, paint_context->redo_stack, paint_context->undo_stack);
+    return paint_context && exchange_history(paint_context, paint_context->redo_stack, paint_context->undo_stack, false);
+}
+
+void pin_history(PaintContext *paint_context) {
+    if (paint_context)
+        paint_context->history_pins++;
+}
+
+void unpin_history(PaintContext *paint_context) {
+    if (!paint_context || paint_context->history_pins == 0)
+        return;
+    if (--paint_context->history_pins == 0) {
+        free_history(&paint_context->retired);
+        init_history(&paint_context->retired);
+        journal_spill(&paint_context->journal, paint_context->undo_stack);
+    }
 }
 
 void free_paint_context(PaintContext *ctx) {
@@ -230,17 +390,19 @@ void free_paint_context(PaintContext *ctx) {
 
     free_history(ctx->redo_stack);
     free(ctx->redo_stack);
+    free_history(&ctx->retired);
 
     if (ctx->current_stroke) {
-        free(ctx->current_stroke->points);
-        free(ctx->current_stroke);
+        canvas_end_recording(ctx->canvas);
         ctx->current_stroke = NULL;
     }
+    free_history_entry(&ctx->stroke);
+    free_point_pool(&ctx->point_pool);
+    free_journal(&ctx->journal);
 
-    if (ctx->bitmap_cache) {
-        SDL_DestroyTexture(ctx->bitmap_cache);
-        ctx->bitmap_cache = NULL;
-    }
+    free_keyframes(&ctx->keyframes);
+    free_canvas(ctx->canvas);
+    ctx->canvas = NULL;
 }
 
 void start_text_input(PaintContext *paint_context, int x, int y) {
@@ -304,19 +466,16 @@ void finalize_text_input(PaintContext *paint_context) {
     }
     
     if (strlen(paint_context->text_input_buffer) > 0) {
-        TTF_Font *text_font = TTF_OpenFont("assets/OpenSans.ttf", paint_context->current_tool.size + 12);
-        if (!text_font) {
+        FontFace *text_face = get_font_face(paint_context->current_tool.size + 12);
+        if (!text_face) {
             paint_context->text_input_active = false;
             SDL_StopTextInput();
             return;
         }
         
-        extern void render_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color color);
-        render_text(paint_context->renderer, text_font, paint_context->text_input_buffer, 
+        render_text(paint_context->canvas, text_face, paint_context->text_input_buffer, 
                    paint_context->text_input_x, paint_context->text_input_y, paint_context->current_tool.color);
         
-        TTF_CloseFont(text_font);
-        
         add_point_to_current_stroke(paint_context, paint_context->text_input_x, paint_context->text_input_y);
         
         if (paint_context->current_stroke) {
@@ -0,0 +1,262 @@
+#include "context/point_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A zigzag-encoded 32-bit value needs at most five 7-bit groups
+#define MAX_VARINT_BYTES 5
+
+static inline Uint32 zigzag_encode(int v) {
+    return ((Uint32)v << 1) ^ (Uint32)(v >> 31);
+}
+
+static inline int zigzag_decode(Uint32 v) {
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static Uint8 *write_varint(Uint8 *out, Uint32 v) {
+    while (v >= 0x80) {
+        *out++ = (Uint8)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (Uint8)v;
+    return out;
+}
+
+static bool read_varint(PointReader *reader, Uint32 *v) {
+    Uint32 value = 0;
+    for (int shift = 0; shift < 7 * MAX_VARINT_BYTES; shift += 7) {
+        if (reader->next >= reader->end)
+            return false;
+        Uint8 byte = *reader->next++;
+        value |= (Uint32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void init_point_pool(PointPool *pool) {
+    pool->current = NULL;
+    pool->spare = NULL;
+}
+
+void free_point_pool(PointPool *pool) {
+    free(pool->current);
+    free(pool->spare);
+    init_point_pool(pool);
+}
+
+static PointChunk *create_chunk(PointPool *pool, size_t size) {
+    PointChunk *chunk = malloc(sizeof(PointChunk) + size);
+    if (!chunk)
+        return NULL;
+    chunk->pool = pool;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->streams = 0;
+    return chunk;
+}
+
+// Drops a chunk nothing refers to any more, keeping one standard chunk around
+static void release_chunk(PointChunk *chunk) {
+    PointPool *pool = chunk->pool;
+    if (!pool->spare && chunk->size == POINT_CHUNK_SIZE) {
+        chunk->used = 0;
+        pool->spare = chunk;
+    } else {
+        free(chunk);
+    }
+}
+
+// Carves `size` bytes from the pool and counts the new stream on its chunk
+static Uint8 *pool_alloc(PointPool *pool, size_t size, PointChunk **out_chunk) {
+    if (size > POINT_CHUNK_SIZE / 4) {
+        // Large streams get a dedicated chunk so they do not waste the tail
+        // of the current one.
+        PointChunk *chunk = create_chunk(pool, size);
+        if (!chunk)
+            return NULL;
+        chunk->used = size;
+        chunk->streams = 1;
+        *out_chunk = chunk;
+        return chunk->data;
+    }
+
+    PointChunk *chunk = pool->current;
+    if (!chunk || chunk->used + size > chunk->size) {
+        PointChunk *fresh = pool->spare;
+        pool->spare = NULL;
+        if (!fresh)
+            fresh = create_chunk(pool, POINT_CHUNK_SIZE);
+        if (!fresh)
+            return NULL;
+        if (chunk && chunk->streams == 0)
+            release_chunk(chunk);
+        pool->current = chunk = fresh;
+    }
+
+    Uint8 *data = chunk->data + chunk->used;
+    chunk->used += size;
+    chunk->streams++;
+    *out_chunk = chunk;
+    return data;
+}
+
+bool encode_points(PointStream *stream, PointPool *pool, const Point *points, int count) {
+    *stream = (PointStream){NULL, 0, 0, NULL};
+    if (count <= 0)
+        return true;
+
+    // Size the encoding first so it can be carved from the pool exactly.
+    Uint8 scratch[2 * MAX_VARINT_BYTES];
+    size_t size = 0;
+    Point last = {0, 0};
+    for (int i = 0; i < count; i++) {
+        Uint8 *out = write_varint(scratch, zigzag_encode(points[i].x - last.x));
+        out = write_varint(out, zigzag_encode(points[i].y - last.y));
+        size += (size_t)(out - scratch);
+        last = points[i];
+    }
+
+    Uint8 *data = pool_alloc(pool, size, &stream->chunk);
+    if (!data)
+        return false;
+
+    Uint8 *out = data;
+    last = (Point){0, 0};
+    for (int i = 0; i < count; i++) {
+        out = write_varint(out, zigzag_encode(points[i].x - last.x));
+        out = write_varint(out, zigzag_encode(points[i].y - last.y));
+        last = points[i];
+    }
+
+    stream->data = data;
+    stream->size = size;
+    stream->count = count;
+    return true;
+}
+
+bool copy_point_stream(PointStream *stream, PointPool *pool, const PointStream *source) {
+    *stream = (PointStream){NULL, 0, 0, NULL};
+    if (source->size == 0)
+        return true;
+
+    Uint8 *data = pool_alloc(pool, source->size, &stream->chunk);
+    if (!data)
+        return false;
+    memcpy(data, source->data, source->size);
+
+    stream->data = data;
+    stream->size = source->size;
+    stream->count = source->count;
+    return true;
+}
+
+void free_point_stream(PointStream *stream) {
+    PointChunk *chunk = stream->chunk;
+    *stream = (PointStream){NULL, 0, 0, NULL};
+    if (!chunk || --chunk->streams > 0)
+        return;
+
+    if (chunk == chunk->pool->current)
+        chunk->used = 0;    // Nothing lives in it any more; start over
+    else
+        release_chunk(chunk);
+}
+
+void init_point_reader(PointReader *reader, const PointStream *stream) {
+    reader->next = stream->data;
+    reader->end = stream->data + stream->size;
+    reader->remaining = stream->count;
+    reader->point = (Point){0, 0};
+}
+
+bool read_point(PointReader *reader, Point *point) {
+    Uint32 dx, dy;
+    if (reader->remaining <= 0 || !read_varint(reader, &dx) || !read_varint(reader, &dy))
+        return false;
+
+    reader->point.x += zigzag_decode(dx);
+    reader->point.y += zigzag_decode(dy);
+    reader->remaining--;
+    *point = reader->point;
+    return true;
+}
+
+int dedup_points(Point *points, int count) {
+    if (count <= 1)
+        return count;
+
+    int kept = 1;
+    for (int i = 1; i < count; i++) {
+        if (points[i].x != points[kept - 1].x || points[i].y != points[kept - 1].y)
+            points[kept++] = points[i];
+    }
+    return kept;
+}
+
+// Squared distance from p to the segment a-b
+static float segment_distance2(Point p, Point a, Point b) {
+    float dx = (float)(b.x - a.x), dy = (float)(b.y - a.y);
+    float px = (float)(p.x - a.x), py = (float)(p.y - a.y);
+    float len2 = dx * dx + dy * dy;
+    float t = len2 > 0 ? (px * dx + py * dy) / len2 : 0;
+    t = SDL_max(0.0f, SDL_min(t, 1.0f));
+    float ex = px - t * dx, ey = py - t * dy;
+    return ex * ex + ey * ey;
+}
+
+int simplify_points(Point *points, int count, float tolerance) {
+    if (count <= 2 || tolerance <= 0)
+        return count;
+
+    bool *keep = calloc(count, sizeof(bool));
+    int *stack = malloc(2 * count * sizeof(int));
+    if (!keep || !stack) {
+        free(keep);
+        free(stack);
+        return count;
+    }
+
+    // Split each range at its farthest point until every dropped point lies
+    // within the tolerance; an explicit stack keeps long strokes off the C stack.
+    const float tolerance2 = tolerance * tolerance;
+    int top = 0;
+    keep[0] = keep[count - 1] = true;
+    stack[top++] = 0;
+    stack[top++] = count - 1;
+    while (top > 0) {
+        int last = stack[--top];
+        int first = stack[--top];
+
+        float worst = tolerance2;
+        int split = -1;
+        for (int i = first + 1; i < last; i++) {
+            float d2 = segment_distance2(points[i], points[first], points[last]);
+            if (d2 > worst) {
+                worst = d2;
+                split = i;
+            }
+        }
+        if (split < 0)
+            continue;
+
+        keep[split] = true;
+        stack[top++] = first;
+        stack[top++] = split;
+        stack[top++] = split;
+        stack[top++] = last;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (keep[i])
+            points[kept++] = points[i];
+    }
+
+    free(keep);
+    free(stack);
+    return kept;
+}
@@ -0,0 +1,231 @@
+#include "context/profile.h"
+
+#ifdef MOBPAINT_PROFILE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "context/logs.h"
+
+#define THREAD_NAME_MAX 32
+
+// A closed zone
+typedef struct {
+    const char *name;
+    Uint64 start;       // Performance counter when it opened
+    Uint64 end;         // Performance counter when it closed
+} ProfileEvent;
+
+// Ring buffer of one thread's zones. Only the owning thread writes events;
+// `head` is published after each one so a dump can tell which slots it may
+// have caught mid-write. Buffers of threads that exited are handed to the
+// next new thread, so short-lived workers do not pile up.
+typedef struct ProfileThread {
+    ProfileEvent events[PROFILE_RING_SIZE];
+    SDL_atomic_t head;              // Zones recorded; the next goes at head % PROFILE_RING_SIZE
+    SDL_atomic_t in_use;            // Owned by a running thread
+    int id;                         // Thread id in exported traces
+    char name[THREAD_NAME_MAX];     // Name in exported traces, empty if unnamed
+    struct ProfileThread *next;
+} ProfileThread;
+
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileThread *threads = NULL;   // Every buffer ever created (guarded by threads_lock)
+static int thread_count = 0;
+static _Thread_local ProfileThread *current_thread = NULL;
+
+static Uint64 epoch;        // Counter value exported as time zero
+static double frequency;    // Counter ticks per second
+
+// Frame durations, main thread only
+static double frame_ms[PROFILE_FRAME_HISTORY];
+static int frame_count = 0;
+static int frame_next = 0;
+static ProfileZone frame_zone = {NULL, 0};
+
+// Runs when a thread that recorded zones exits
+static void release_thread(void *data) {
+    ProfileThread *thread = data;
+    SDL_AtomicSet(&thread->in_use, 0);
+}
+
+static void init_profile(void) {
+    pthread_key_create(&thread_key, release_thread);
+    epoch = SDL_GetPerformanceCounter();
+    frequency = (double)SDL_GetPerformanceFrequency();
+}
+
+// Returns the calling thread's buffer, claiming one on first use
+static ProfileThread *this_thread(void) {
+    if (current_thread)
+        return current_thread;
+    pthread_once(&profile_once, init_profile);
+
+    pthread_mutex_lock(&threads_lock);
+    ProfileThread *thread = threads;
+    while (thread && SDL_AtomicGet(&thread->in_use))
+        thread = thread->next;
+    if (!thread) {
+        thread = calloc(1, sizeof(ProfileThread));
+        if (thread) {
+            thread->id = ++thread_count;
+            thread->next = threads;
+            threads = thread;
+        }
+    }
+    if (thread) {
+        SDL_AtomicSet(&thread->in_use, 1);
+        thread->name[0] = '\0';
+    }
+    pthread_mutex_unlock(&threads_lock);
+
+    if (!thread)
+        return NULL;
+    pthread_setspecific(thread_key, thread);
+    current_thread = thread;
+    return thread;
+}
+
+static void record_zone(const char *name, Uint64 start, Uint64 end) {
+    ProfileThread *thread = this_thread();
+    if (!thread)
+        return;
+    Uint32 head = (Uint32)SDL_AtomicGet(&thread->head);
+    thread->events[head % PROFILE_RING_SIZE] = (ProfileEvent){name, start, end};
+    SDL_AtomicSet(&thread->head, (int)(head + 1));
+}
+
+ProfileZone profile_begin(const char *name) {
+    return (ProfileZone){name, SDL_GetPerformanceCounter()};
+}
+
+void profile_end(ProfileZone *zone) {
+    record_zone(zone->name, zone->start, SDL_GetPerformanceCounter());
+}
+
+void profile_thread_name(const char *name) {
+    ProfileThread *thread = this_thread();
+    if (!thread)
+        return;
+    pthread_mutex_lock(&threads_lock);
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+    pthread_mutex_unlock(&threads_lock);
+}
+
+void profile_begin_frame(void) {
+    frame_zone = profile_begin("frame");
+}
+
+void profile_end_frame(void) {
+    if (!frame_zone.name)
+        return;
+    Uint64 end = SDL_GetPerformanceCounter();
+    record_zone(frame_zone.name, frame_zone.start, end);
+
+    frame_ms[frame_next] = (double)(end - frame_zone.start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+    frame_next = (frame_next + 1) % PROFILE_FRAME_HISTORY;
+    if (frame_count < PROFILE_FRAME_HISTORY)
+        frame_count++;
+    frame_zone.name = NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *sorted, int count, int percent) {
+    int rank = (count * percent + 99) / 100;
+    return sorted[SDL_max(rank, 1) - 1];
+}
+
+bool profile_frame_stats(FrameStats *stats) {
+    if (frame_count == 0)
+        return false;
+
+    double sorted[PROFILE_FRAME_HISTORY];
+    memcpy(sorted, frame_ms, (size_t)frame_count * sizeof(double));
+    qsort(sorted, (size_t)frame_count, sizeof(double), compare_double);
+
+    stats->frames = frame_count;
+    stats->p50 = percentile(sorted, frame_count, 50);
+    stats->p95 = percentile(sorted, frame_count, 95);
+    stats->p99 = percentile(sorted, frame_count, 99);
+    stats->max = sorted[frame_count - 1];
+    return true;
+}
+
+// Microseconds since the epoch; zones opened before it come out negative
+static double trace_time(Uint64 counter) {
+    return (double)(Sint64)(counter - epoch) * 1e6 / frequency;
+}
+
+// Writes a thread's zones as complete ("X") events. The ring is copied
+// first; slots the owner may have rewritten during the copy are skipped.
+static void write_thread_events(FILE *file, ProfileThread *thread, ProfileEvent *copy, bool *first) {
+    Uint32 before = (Uint32)SDL_AtomicGet(&thread->head);
+    memcpy(copy, thread->events, sizeof(thread->events));
+    Uint32 after = (Uint32)SDL_AtomicGet(&thread->head);
+
+    Uint32 count = SDL_min(before, (Uint32)PROFILE_RING_SIZE);
+    Uint32 oldest = before - count;
+    // Writes since the first read reach back to slot after - RING_SIZE,
+    // including the one possibly in progress at `after`.
+    Uint32 reach = after + 1 - oldest;
+    Uint32 lost = reach > PROFILE_RING_SIZE ? reach - PROFILE_RING_SIZE : 0;
+
+    for (Uint32 i = oldest + SDL_min(lost, count); i != before; i++) {
+        const ProfileEvent *event = &copy[i % PROFILE_RING_SIZE];
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                *first ? "" : ",\n", event->name, thread->id,
+                trace_time(event->start), (double)(event->end - event->start) * 1e6 / frequency);
+        *first = false;
+    }
+}
+
+bool profile_dump_trace(const char *path) {
+    pthread_once(&profile_once, init_profile);
+
+    ProfileEvent *copy = malloc(sizeof(ProfileEvent) * PROFILE_RING_SIZE);
+    if (!copy) {
+        log_error("Failed to allocate trace buffer");
+        return false;
+    }
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        log_error("Failed to open trace file %s", path);
+        free(copy);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    pthread_mutex_lock(&threads_lock);
+    for (ProfileThread *thread = threads; thread; thread = thread->next) {
+        char name[THREAD_NAME_MAX + 16];
+        if (thread->name[0])
+            snprintf(name, sizeof(name), "%s", thread->name);
+        else
+            snprintf(name, sizeof(name), "thread %d", thread->id);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", thread->id, name);
+        first = false;
+        write_thread_events(file, thread, copy, &first);
+    }
+    pthread_mutex_unlock(&threads_lock);
+    fprintf(file, "\n]}\n");
+
+    free(copy);
+    if (fclose(file) != 0) {
+        log_error("Failed to write trace file %s", path);
+        return false;
+    }
+    return true;
+}
+
+#endif // MOBPAINT_PROFILE
@@ -0,0 +1,175 @@
+#include "context/replay.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include "context/paint_context.h"
+#include "context/profile.h"
+
+#define TS CANVAS_TILE_SIZE
+
+// Rows [top, bottom] an entry may write; empty when top > bottom
+typedef struct EntryRows {
+    int top;
+    int bottom;
+} EntryRows;
+
+// A run of entries being replayed band by band
+typedef struct ReplayJob {
+    Canvas *canvas;                 // Canvas whose tile array the workers share
+    const HistoryEntry *entries;    // Entries of the run, no text or clears
+    const EntryRows *rows;          // Rows each entry may write
+    int count;                      // Number of entries
+    SDL_atomic_t next_band;         // Next tile row nobody took yet
+} ReplayJob;
+
+typedef struct ReplayWorker {
+    ReplayJob *job;
+    DirtyRegion dirty;              // Area this worker wrote
+} ReplayWorker;
+
+// Conservative row bounds of what apply_history_entry() draws for an entry.
+// The margins cover the brush radius and the rounding of the rasterizers.
+static EntryRows entry_rows(const HistoryEntry *entry) {
+    EntryRows rows = {1, 0};
+    if (entry->count == 0)
+        return rows;
+
+    if (entry->tool.type == TOOL_FILL) {
+        for (int i = 0; i < entry->span_count; i++) {
+            rows.top = i ? SDL_min(rows.top, entry->spans[i].y) : entry->spans[i].y;
+            rows.bottom = i ? SDL_max(rows.bottom, entry->spans[i].y) : entry->spans[i].y;
+        }
+        return rows;
+    }
+
+    PointReader reader;
+    Point last, curr;
+    init_point_reader(&reader, &entry->stream);
+    if (!read_point(&reader, &last))
+        return rows;
+    const int size = SDL_max(entry->tool.size, 1);
+
+    if (entry->tool.type == TOOL_CIRCLE) {
+        // Each pair of points spans a circle's diameter; its outer radius,
+        // doubled, is at most the pair's Manhattan distance plus the size.
+        while (read_point(&reader, &curr)) {
+            const int sy = last.y + curr.y;
+            const int reach = abs(curr.x - last.x) + abs(curr.y - last.y) + 1 + size;
+            const EntryRows pair = {(sy - reach) / 2 - 1, (sy + reach) / 2 + 1};
+            rows.top = rows.top > rows.bottom ? pair.top : SDL_min(rows.top, pair.top);
+            rows.bottom = SDL_max(rows.bottom, pair.bottom);
+            last = curr;
+        }
+        return rows;
+    }
+
+    int top = last.y, bottom = last.y;
+    while (read_point(&reader, &curr)) {
+        top = SDL_min(top, curr.y);
+        bottom = SDL_max(bottom, curr.y);
+    }
+    rows.top = top - size / 2 - 1;
+    rows.bottom = bottom + size / 2 + 1;
+    return rows;
+}
+
+// Takes tile rows until none are left and replays the entries reaching
+// each one. The worker draws through a copy of the canvas that shares its
+// tiles but has its own clip rectangle and damage.
+static void *replay_worker(void *data) {
+    ReplayWorker *worker = data;
+    ReplayJob *job = worker->job;
+
+    Canvas view = *job->canvas;
+    dirty_region_clear(&view.dirty);
+
+    for (;;) {
+        int band = SDL_AtomicAdd(&job->next_band, 1);
+        if (band >= view.tiles_y)
+            break;
+
+        SDL_Rect rect = {0, band * TS, view.width, TS};
+        if (!SDL_IntersectRect(&rect, &job->canvas->clip, &view.clip))
+            continue;
+
+        PROFILE_SCOPE("replay_band");
+        const int top = view.clip.y;
+        const int bottom = view.clip.y + view.clip.h - 1;
+        for (int i = 0; i < job->count; i++) {
+            if (job->rows[i].top <= bottom && job->rows[i].bottom >= top)
+                apply_history_entry(&view, &job->entries[i]);
+        }
+    }
+
+    worker->dirty = view.dirty;
+    return NULL;
+}
+
+// Entry point of the extra workers; the calling thread runs replay_worker() itself.
+static void *replay_thread(void *data) {
+    profile_thread_name("replay");
+    return replay_worker(data);
+}
+
+// Replays a run of entries without text or clears across `threads` threads, the calling
+// one included. Workers that fail to start just leave more bands to the rest.
+static void replay_run(Canvas *canvas, const HistoryEntry *entries, EntryRows *rows, int count, int threads) {
+    if (count < REPLAY_PARALLEL_MIN_ENTRIES) {
+        for (int i = 0; i < count; i++)
+            apply_history_entry(canvas, &entries[i]);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        rows[i] = entry_rows(&entries[i]);
+
+    ReplayJob job = {canvas, entries, rows, count, {0}};
+    SDL_AtomicSet(&job.next_band, 0);
+
+    ReplayWorker workers[REPLAY_MAX_THREADS];
+    pthread_t handles[REPLAY_MAX_THREADS];
+    bool started[REPLAY_MAX_THREADS] = {false};
+    for (int i = 0; i < threads; i++)
+        workers[i].job = &job;
+    for (int i = 1; i < threads; i++)
+        started[i] = pthread_create(&handles[i], NULL, replay_thread, &workers[i]) == 0;
+
+    replay_worker(&workers[0]);
+    dirty_region_merge(&canvas->dirty, &workers[0].dirty);
+    for (int i = 1; i < threads; i++) {
+        if (!started[i])
+            continue;
+        pthread_join(handles[i], NULL);
+        dirty_region_merge(&canvas->dirty, &workers[i].dirty);
+    }
+}
+
+void replay_history(Canvas *canvas, const HistoryEntry *entries, int count, int threads) {
+    if (!canvas || !entries || count <= 0)
+        return;
+
+    PROFILE_SCOPE("replay_history");
+
+    if (threads <= 0)
+        threads = SDL_GetCPUCount();
+    threads = SDL_min(threads, SDL_min(canvas->tiles_y, REPLAY_MAX_THREADS));
+
+    // A recording captures tiles through the canvas itself, one writer only.
+    EntryRows *rows = threads > 1 && !canvas->recording ? malloc(count * sizeof(EntryRows)) : NULL;
+    if (!rows) {
+        for (int i = 0; i < count; i++)
+            apply_history_entry(canvas, &entries[i]);
+        return;
+    }
+
+    int first = 0;
+    while (first < count) {
+        int last = first;
+        while (last < count && entries[last].tool.type != TOOL_TEXT && entries[last].tool.type != TOOL_CLEAR)
+            last++;
+        replay_run(canvas, entries + first, rows, last - first, threads);
+        if (last < count)
+            apply_history_entry(canvas, &entries[last]);
+        first = last + 1;
+    }
+    free(rows);
+}
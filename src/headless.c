@@ -0,0 +1,101 @@
+#include "headless.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+#include <strings.h>
+#include <string.h>
+#include "canvas/pixel_ops.h"
+#include "context/document.h"
+#include "context/logs.h"
+#include "context/paint_context.h"
+#include "tools/font_cache.h"
+
+// Milliseconds between two performance counter values
+static double elapsed_ms(Uint64 start, Uint64 end) {
+    return (double)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+// Writes the canvas with straight alpha, as image files expect
+static bool save_canvas_image(const Canvas *canvas, const char *path) {
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, canvas->width, canvas->height, 32,
+                                                          CANVAS_PIXEL_FORMAT);
+    if (!surface) {
+        log_error("Failed to allocate a %dx%d image: %s", canvas->width, canvas->height, SDL_GetError());
+        return false;
+    }
+
+    SDL_Rect area = {0, 0, canvas->width, canvas->height};
+    int pitch = surface->pitch / (int)sizeof(Uint32);
+    Uint32 *pixels = surface->pixels;
+    canvas_read_pixels(canvas, &area, pixels, pitch);
+    for (int y = 0; y < canvas->height; y++) {
+        Uint32 *row = pixels + (size_t)y * pitch;
+        for (int x = 0; x < canvas->width; x++)
+            row[x] = unpremultiply_pixel(row[x]);
+    }
+
+    size_t length = strlen(path);
+    bool bmp = length >= 4 && strcasecmp(path + length - 4, ".bmp") == 0;
+    bool saved = (bmp ? SDL_SaveBMP(surface, path) : IMG_SavePNG(surface, path)) == 0;
+    if (!saved)
+        log_error("Failed to write %s: %s", path, SDL_GetError());
+    SDL_FreeSurface(surface);
+    return saved;
+}
+
+int run_headless(const char *document_path, const char *image_path, Config *config) {
+    log_info("Rendering %s to %s", document_path, image_path);
+
+    // No video: only timers and the font renderer are needed
+    if (SDL_Init(0) != 0 || TTF_Init() == -1) {
+        log_error("Headless init error: %s", SDL_GetError());
+        return 1;
+    }
+
+    int width, height;
+    if (!document_peek_size(document_path, &width, &height)) {
+        log_error("%s is not a readable MobPaint document", document_path);
+        TTF_Quit();
+        SDL_Quit();
+        return 1;
+    }
+    config->window_width = width;
+    config->window_height = height;
+
+    PaintContext context;
+    Tool tool;
+    init_tool(&tool, config);
+    init_paint_context(NULL, &context, config, tool);
+    if (!context.canvas) {
+        free_paint_context(&context);
+        TTF_Quit();
+        SDL_Quit();
+        return 1;
+    }
+
+    Document document;
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool ok = open_document_read_only(&document, document_path, &context);
+    Uint64 loaded = SDL_GetPerformanceCounter();
+
+    if (ok) {
+        // The saved raster is already on the canvas; drawing it again from
+        // history is what exercises (and profiles) the raster path. Only the
+        // base raster keyframe is kept so the redraw replays every entry
+        // instead of starting from one taken while loading.
+        keyframes_truncate(&context.keyframes, 0, NULL);
+        redraw_canvas(&context);
+        Uint64 replayed = SDL_GetPerformanceCounter();
+        log_info("Loaded %s in %.1f ms, replayed %d history entries in %.1f ms",
+                 document_path, elapsed_ms(start, loaded), context.undo_stack->count,
+                 elapsed_ms(loaded, replayed));
+        ok = save_canvas_image(context.canvas, image_path);
+    }
+
+    free_paint_context(&context);
+    close_document(&document);
+    free_font_cache();
+    TTF_Quit();
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
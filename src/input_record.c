@@ -0,0 +1,387 @@
+#define _POSIX_C_SOURCE 200809L
+#include "input_record.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "context/logs.h"
+
+typedef enum {
+    INPUT_FRAME,        // A frame was presented
+    INPUT_QUIT,
+    INPUT_BUTTON_DOWN,  // Button, position
+    INPUT_BUTTON_UP,    // Button, position
+    INPUT_MOTION,       // Position, button state
+    INPUT_KEY_DOWN,     // Key code, modifiers
+    INPUT_TEXT,         // Length, UTF-8 bytes
+    INPUT_END           // Final canvas checksum (4 bytes)
+} InputKind;
+
+typedef struct {
+    char magic[8];
+    Uint32 version;
+    Sint32 width;
+    Sint32 height;
+    Uint32 checksum;    // Canvas checksum when the session started
+} InputHeader;
+
+// Longest record: kind, time, text length and text
+#define INPUT_RECORD_MAX (1 + 5 + 5 + SDL_TEXTINPUTEVENT_TEXT_SIZE)
+
+static size_t put_varint(Uint8 *out, Uint32 value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (Uint8)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (Uint8)value;
+    return length;
+}
+
+static Uint32 zigzag(int value) {
+    return ((Uint32)value << 1) ^ (Uint32)(value < 0 ? -1 : 0);
+}
+
+static int unzigzag(Uint32 value) {
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+bool open_input_recording(InputRecorder *recorder, const char *path, const Canvas *canvas) {
+    *recorder = (InputRecorder){NULL, SDL_GetTicks(), 0, 0};
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        log_error("Failed to create input recording %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    InputHeader header = {{0}, INPUT_VERSION, canvas->width, canvas->height, canvas_checksum(canvas)};
+    memcpy(header.magic, INPUT_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        log_error("Failed to write input recording %s: %s", path, strerror(errno));
+        fclose(file);
+        return false;
+    }
+
+    recorder->file = file;
+    log_info("Recording input to %s.", path);
+    return true;
+}
+
+// Appends a record; the time is taken relative to the previous one. A
+// write error ends the recording.
+static void write_record(InputRecorder *recorder, InputKind kind, Uint32 ticks,
+                         const Uint8 *payload, size_t size) {
+    if (!recorder->file)
+        return;
+
+    // Event timestamps may trail the frame ticks a little; time never goes back
+    Uint32 delta = 0;
+    if ((Sint32)(ticks - recorder->last_ticks) > 0) {
+        delta = ticks - recorder->last_ticks;
+        recorder->last_ticks = ticks;
+    }
+
+    Uint8 record[INPUT_RECORD_MAX];
+    size_t length = 0;
+    record[length++] = (Uint8)kind;
+    length += put_varint(record + length, delta);
+    if (size > 0)
+        memcpy(record + length, payload, size);
+    length += size;
+
+    if (fwrite(record, 1, length, recorder->file) != length) {
+        log_error("Failed to write input recording: %s", strerror(errno));
+        fclose(recorder->file);
+        recorder->file = NULL;
+    }
+}
+
+// Encodes a mouse position as the offset from the previous one
+static size_t put_position(InputRecorder *recorder, Uint8 *out, int x, int y) {
+    size_t length = put_varint(out, zigzag(x - recorder->last_x));
+    length += put_varint(out + length, zigzag(y - recorder->last_y));
+    recorder->last_x = x;
+    recorder->last_y = y;
+    return length;
+}
+
+void record_input_event(InputRecorder *recorder, const SDL_Event *event) {
+    if (!recorder->file)
+        return;
+
+    Uint8 payload[INPUT_RECORD_MAX];
+    size_t size = 0;
+    InputKind kind;
+
+    switch (event->type) {
+        case SDL_QUIT:
+            kind = INPUT_QUIT;
+            break;
+
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            kind = event->type == SDL_MOUSEBUTTONDOWN ? INPUT_BUTTON_DOWN : INPUT_BUTTON_UP;
+            payload[size++] = event->button.button;
+            size += put_position(recorder, payload + size, event->button.x, event->button.y);
+            break;
+
+        case SDL_MOUSEMOTION:
+            kind = INPUT_MOTION;
+            size += put_position(recorder, payload + size, event->motion.x, event->motion.y);
+            size += put_varint(payload + size, event->motion.state);
+            break;
+
+        case SDL_KEYDOWN:
+            kind = INPUT_KEY_DOWN;
+            size += put_varint(payload + size, (Uint32)event->key.keysym.sym);
+            size += put_varint(payload + size, event->key.keysym.mod);
+            break;
+
+        case SDL_TEXTINPUT: {
+            kind = INPUT_TEXT;
+            size_t length = strnlen(event->text.text, SDL_TEXTINPUTEVENT_TEXT_SIZE - 1);
+            size += put_varint(payload + size, (Uint32)length);
+            memcpy(payload + size, event->text.text, length);
+            size += length;
+            break;
+        }
+
+        default:
+            // Window events only cause repaints, which replay does on its own
+            return;
+    }
+
+    write_record(recorder, kind, event->common.timestamp, payload, size);
+}
+
+void record_input_frame(InputRecorder *recorder) {
+    write_record(recorder, INPUT_FRAME, SDL_GetTicks(), NULL, 0);
+}
+
+void close_input_recording(InputRecorder *recorder, const Canvas *canvas) {
+    if (!recorder->file)
+        return;
+
+    Uint32 checksum = canvas_checksum(canvas);
+    Uint8 payload[sizeof(checksum)];
+    memcpy(payload, &checksum, sizeof(checksum));
+    write_record(recorder, INPUT_END, SDL_GetTicks(), payload, sizeof(payload));
+
+    if (recorder->file && fclose(recorder->file) != 0)
+        log_error("Failed to write input recording: %s", strerror(errno));
+    recorder->file = NULL;
+    log_info("Input recording ended; canvas checksum %08x.", (unsigned)checksum);
+}
+
+bool open_input_replay(InputReplay *replay, const char *path, const Canvas *canvas, bool realtime) {
+    memset(replay, 0, sizeof(*replay));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        log_error("Failed to open input recording %s: %s", path, strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    Uint8 *data = size > 0 ? malloc((size_t)size) : NULL;
+    bool read = data && fread(data, 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+
+    InputHeader header;
+    if (!read || (size_t)size < sizeof(header)) {
+        log_error("Failed to read input recording %s", path);
+        free(data);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, INPUT_MAGIC, sizeof(header.magic)) != 0 || header.version != INPUT_VERSION) {
+        log_error("%s is not an input recording this build can replay", path);
+        free(data);
+        return false;
+    }
+    // Positions only mean the same thing on a canvas of the same size
+    if (header.width != canvas->width || header.height != canvas->height) {
+        log_error("Input recording %s is for a %dx%d canvas, not %dx%d", path,
+                  header.width, header.height, canvas->width, canvas->height);
+        free(data);
+        return false;
+    }
+    if (header.checksum != canvas_checksum(canvas))
+        log_error("Input recording %s started from a different canvas; the result will differ", path);
+
+    replay->data = data;
+    replay->size = (size_t)size;
+    replay->offset = sizeof(header);
+    replay->realtime = realtime;
+    replay->start_ticks = SDL_GetTicks();
+    replay->started = SDL_GetPerformanceCounter();
+    log_info("Replaying input from %s%s.", path, realtime ? " at the recorded pace" : "");
+    return true;
+}
+
+static bool read_varint(InputReplay *replay, Uint32 *value) {
+    Uint32 result = 0;
+    for (int shift = 0; shift < 35 && replay->offset < replay->size; shift += 7) {
+        Uint8 byte = replay->data[replay->offset++];
+        result |= (Uint32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool read_position(InputReplay *replay, int *x, int *y) {
+    Uint32 dx, dy;
+    if (!read_varint(replay, &dx) || !read_varint(replay, &dy))
+        return false;
+    replay->last_x += unzigzag(dx);
+    replay->last_y += unzigzag(dy);
+    *x = replay->last_x;
+    *y = replay->last_y;
+    return true;
+}
+
+static bool read_bytes(InputReplay *replay, void *out, size_t size) {
+    if (replay->size - replay->offset < size)
+        return false;
+    memcpy(out, replay->data + replay->offset, size);
+    replay->offset += size;
+    return true;
+}
+
+// Holds a record back until its time comes around again
+static void wait_for_record(InputReplay *replay) {
+    if (!replay->realtime)
+        return;
+    Sint32 ahead = (Sint32)(replay->start_ticks + replay->elapsed_ms - SDL_GetTicks());
+    if (ahead <= 0)
+        return;
+    Uint64 before = SDL_GetPerformanceCounter();
+    SDL_Delay((Uint32)ahead);
+    replay->wait_ms += (double)(SDL_GetPerformanceCounter() - before) * 1000.0 /
+                       (double)SDL_GetPerformanceFrequency();
+}
+
+bool next_input_event(InputReplay *replay, SDL_Event *event) {
+    replay->frame = false;
+    if (replay->finished)
+        return false;
+
+    // A recording cut short by a crash replays up to its last whole record
+    Uint8 kind;
+    Uint32 delta;
+    if (!read_bytes(replay, &kind, 1) || !read_varint(replay, &delta)) {
+        replay->finished = true;
+        return false;
+    }
+    replay->elapsed_ms += delta;
+    wait_for_record(replay);
+
+    memset(event, 0, sizeof(*event));
+    bool ok = true;
+    switch (kind) {
+        case INPUT_FRAME:
+            replay->frame = true;
+            return false;
+
+        case INPUT_END:
+            replay->has_checksum = read_bytes(replay, &replay->checksum, sizeof(replay->checksum));
+            replay->finished = true;
+            return false;
+
+        case INPUT_QUIT:
+            event->type = SDL_QUIT;
+            break;
+
+        case INPUT_BUTTON_DOWN:
+        case INPUT_BUTTON_UP:
+            event->type = kind == INPUT_BUTTON_DOWN ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            event->button.state = kind == INPUT_BUTTON_DOWN ? SDL_PRESSED : SDL_RELEASED;
+            event->button.clicks = 1;
+            ok = read_bytes(replay, &event->button.button, 1) &&
+                 read_position(replay, &event->button.x, &event->button.y);
+            break;
+
+        case INPUT_MOTION: {
+            int previous_x = replay->last_x, previous_y = replay->last_y;
+            Uint32 state;
+            event->type = SDL_MOUSEMOTION;
+            ok = read_position(replay, &event->motion.x, &event->motion.y) && read_varint(replay, &state);
+            event->motion.xrel = event->motion.x - previous_x;
+            event->motion.yrel = event->motion.y - previous_y;
+            event->motion.state = ok ? state : 0;
+            break;
+        }
+
+        case INPUT_KEY_DOWN: {
+            Uint32 sym, mod;
+            event->type = SDL_KEYDOWN;
+            event->key.state = SDL_PRESSED;
+            ok = read_varint(replay, &sym) && read_varint(replay, &mod);
+            event->key.keysym.sym = ok ? (SDL_Keycode)sym : 0;
+            event->key.keysym.mod = ok ? (Uint16)mod : 0;
+            break;
+        }
+
+        case INPUT_TEXT: {
+            Uint32 length;
+            event->type = SDL_TEXTINPUT;
+            ok = read_varint(replay, &length) && length < SDL_TEXTINPUTEVENT_TEXT_SIZE &&
+                 read_bytes(replay, event->text.text, length);
+            break;
+        }
+
+        default:
+            log_error("Unknown record %d in input recording; replay stops here", kind);
+            ok = false;
+            break;
+    }
+
+    if (!ok) {
+        replay->finished = true;
+        return false;
+    }
+    event->common.timestamp = SDL_GetTicks();
+    replay->events++;
+    return true;
+}
+
+void input_replay_frame_done(InputReplay *replay, double ms) {
+    ms = SDL_max(ms - replay->wait_ms, 0.0);
+    replay->wait_ms = 0;
+    replay->frames++;
+    replay->frame_ms += ms;
+    replay->max_frame_ms = SDL_max(replay->max_frame_ms, ms);
+}
+
+bool close_input_replay(InputReplay *replay, const Canvas *canvas) {
+    // A session that quit early still has the recorded checksum at the end
+    SDL_Event event;
+    int events = replay->events;
+    replay->realtime = false;
+    while (!replay->finished)
+        next_input_event(replay, &event);
+
+    double total_ms = (double)(SDL_GetPerformanceCounter() - replay->started) * 1000.0 /
+                      (double)SDL_GetPerformanceFrequency();
+    Uint32 checksum = canvas_checksum(canvas);
+    bool matches = !replay->has_checksum || checksum == replay->checksum;
+
+    char summary[256];
+    snprintf(summary, sizeof(summary),
+             "Replayed %d events in %d frames: %.1f ms total, %.3f ms per frame on average, %.3f ms at most; "
+             "canvas checksum %08x %s",
+             events, replay->frames, total_ms, replay->frames ? replay->frame_ms / replay->frames : 0.0,
+             replay->max_frame_ms, (unsigned)checksum,
+             !replay->has_checksum ? "(none recorded)" : matches ? "matches the recording" : "DIFFERS from the recording");
+    printf("%s\n", summary);
+    log_info("%s", summary);
+
+    free(replay->data);
+    replay->data = NULL;
+    return matches;
+}
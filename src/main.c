@@ -1,14 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <SDL2/SDL.h>
 #include "context/logs.h"
 #include "context/config.h"
+#include "headless.h"
+#include "app.h"
 
 #define MAX_PATH_LEN 512
 
-extern int run_app(const char *target_file_path, Config *config);
+static int usage(const char *program) {
+    fprintf(stderr, "usage: %s [--record EVENTS | --replay EVENTS [--realtime]] [TARGET]\n"
+                    "       %s --render DOCUMENT IMAGE\n", program, program);
+    close_logs();
+    return 2;
+}
 
 int main(int argc, char *argv[]) {
+    // Startup is timed from here to the first frame
+    Uint64 start = SDL_GetPerformanceCounter();
+
     if (!init_logs()) {
         fprintf(stderr, "Failed to initialize logs.\n");
         return 1;
@@ -17,10 +28,37 @@ int main(int argc, char *argv[]) {
     Config config;
     load_config("config.json", &config);
 
+    // mobpaint --render DOCUMENT IMAGE renders without opening a window
+    if (argc > 1 && strcmp(argv[1], "--render") == 0) {
+        if (argc != 4)
+            return usage(argv[0]);
+        int result = run_headless(argv[2], argv[3], &config);
+        close_logs();
+        return result;
+    }
+
+    // --record EVENTS saves the session's input, --replay EVENTS plays it back
+    InputOptions input = {NULL, NULL, false};
+    const char *target_arg = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            input.record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            input.replay_path = argv[++i];
+        else if (strcmp(argv[i], "--realtime") == 0)
+            input.replay_realtime = true;
+        else if (argv[i][0] == '-' || target_arg)
+            return usage(argv[0]);
+        else
+            target_arg = argv[i];
+    }
+    if ((input.record_path && input.replay_path) || (input.replay_realtime && !input.replay_path))
+        return usage(argv[0]);
+
     char target_file_path[MAX_PATH_LEN] = {0};
 
-    if (argc > 1) {
-        snprintf(target_file_path, MAX_PATH_LEN, "%s", argv[1]);
+    if (target_arg) {
+        snprintf(target_file_path, MAX_PATH_LEN, "%s", target_arg);
         log_info("User specified target file: %s", target_file_path);
     } else if (strlen(config.default_target_path) > 0) {
         snprintf(target_file_path, MAX_PATH_LEN, "%s", config.default_target_path);
@@ -40,7 +78,7 @@ int main(int argc, char *argv[]) {
         log_info("No target or config path, using fallback temp file: %s", target_file_path);
     }
 
-    int result = run_app(target_file_path, &config);
+    int result = run_app(target_file_path, &config, start, &input);
 
     close_logs();
     return result;
@@ -34,16 +34,16 @@ void draw_topbar(SDL_Renderer *renderer, PaintContext *context, Config *config,
         SDL_Texture *icon = NULL;
         switch ((TopbarButton)i) {
         case TOPBAR_BTN_UNDO:       
-            icon = global_assets->undo;  
+            icon = get_icon(global_assets, ICON_UNDO);  
             break;
         case TOPBAR_BTN_REDO:       
-            icon = global_assets->redo;  
+            icon = get_icon(global_assets, ICON_REDO);  
             break;
         case TOPBAR_BTN_SIZE_INC:   
-            icon = global_assets->plus;  
+            icon = get_icon(global_assets, ICON_PLUS);  
             break;
         case TOPBAR_BTN_SIZE_DEC:   
-            icon = global_assets->minus; 
+            icon = get_icon(global_assets, ICON_MINUS); 
             break;
         default: 
             break;
@@ -56,7 +56,7 @@ void draw_topbar(SDL_Renderer *renderer, PaintContext *context, Config *config,
     snprintf(size_text, sizeof(size_text), "Size: %d", context->current_tool.size);
 
     SDL_Color white = {255, 255, 255, 255};
-    SDL_Surface *surface = TTF_RenderText_Blended(font, size_text, white);
+    SDL_Surface *surface = font ? TTF_RenderText_Blended(font, size_text, white) : NULL;
     if (surface) {
         SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
         SDL_Rect text_rect = {
@@ -121,8 +121,9 @@ void draw_left_sidebar(SDL_Renderer *renderer, PaintContext *context, Config *co
         };
         SDL_RenderDrawRect(renderer, &btn);
 
-        if (global_assets->tool_icons[i]) {
-            SDL_RenderCopy(renderer, global_assets->tool_icons[i], NULL, &btn);
+        SDL_Texture *icon = get_icon(global_assets, (AssetIcon)(ICON_BRUSH + i));
+        if (icon) {
+            SDL_RenderCopy(renderer, icon, NULL, &btn);
         }
 
         if (context->current_tool.type == (ToolType)i) {
@@ -226,4 +227,68 @@ void handle_color_palette_click(PaintContext *context, Config *config, int mouse
             return;
         }
     }
-}
\ No newline at end of file
+}
+
+void init_chrome_cache(ChromeCache *cache, SDL_Renderer *renderer, Config *config) {
+    cache->valid = false;
+    cache->topbar = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                      config->window_width, TOPBAR_HEIGHT);
+    cache->sidebar = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                       SIDEBAR_WIDTH, config->window_height);
+    if (!cache->topbar || !cache->sidebar) {
+        free_chrome_cache(cache);
+        return;
+    }
+
+    // The chrome is opaque, so copying it needs no blending.
+    SDL_SetTextureBlendMode(cache->topbar, SDL_BLENDMODE_NONE);
+    SDL_SetTextureBlendMode(cache->sidebar, SDL_BLENDMODE_NONE);
+}
+
+bool update_chrome_cache(ChromeCache *cache, SDL_Renderer *renderer, PaintContext *context,
+                         Config *config, TTF_Font *font) {
+    const Tool *tool = &context->current_tool;
+    if (cache->valid && cache->tool_type == tool->type && cache->tool_size == tool->size &&
+        cache->tool_color.r == tool->color.r && cache->tool_color.g == tool->color.g &&
+        cache->tool_color.b == tool->color.b && cache->tool_color.a == tool->color.a)
+        return false;
+
+    cache->tool_type = tool->type;
+    cache->tool_size = tool->size;
+    cache->tool_color = tool->color;
+    if (!cache->topbar || !cache->sidebar)
+        return true;
+
+    SDL_SetRenderTarget(renderer, cache->topbar);
+    draw_topbar(renderer, context, config, font);
+    SDL_SetRenderTarget(renderer, cache->sidebar);
+    draw_left_sidebar(renderer, context, config);
+    SDL_SetRenderTarget(renderer, NULL);
+
+    cache->valid = true;
+    return true;
+}
+
+void draw_chrome(ChromeCache *cache, SDL_Renderer *renderer, PaintContext *context,
+                 Config *config, TTF_Font *font) {
+    if (!cache->valid) {
+        draw_topbar(renderer, context, config, font);
+        draw_left_sidebar(renderer, context, config);
+        return;
+    }
+
+    SDL_Rect topbar = {0, 0, config->window_width, TOPBAR_HEIGHT};
+    SDL_Rect sidebar = {0, 0, SIDEBAR_WIDTH, config->window_height};
+    SDL_RenderCopy(renderer, cache->topbar, NULL, &topbar);
+    SDL_RenderCopy(renderer, cache->sidebar, NULL, &sidebar);
+}
+
+void free_chrome_cache(ChromeCache *cache) {
+    if (cache->topbar)
+        SDL_DestroyTexture(cache->topbar);
+    if (cache->sidebar)
+        SDL_DestroyTexture(cache->sidebar);
+    cache->topbar = NULL;
+    cache->sidebar = NULL;
+    cache->valid = false;
+}
@@ -0,0 +1,233 @@
+#include "tools/font_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include "asset_pack.h"
+#include "context/logs.h"
+
+#define INITIAL_CAPACITY 64
+
+static FontFace *faces = NULL;
+
+static FontFace *create_font_face(int size) {
+    // Every face reads the font embedded in the binary
+    SDL_RWops *data = SDL_RWFromConstMem(asset_open_sans.data, (int)asset_open_sans.size);
+    TTF_Font *font = data ? TTF_OpenFontRW(data, 1, size) : NULL;
+    if (!font) {
+        log_error("Failed to open font at size %d: %s", size, TTF_GetError());
+        return NULL;
+    }
+
+    FontFace *face = calloc(1, sizeof(FontFace));
+    if (!face) {
+        TTF_CloseFont(font);
+        return NULL;
+    }
+    face->size = size;
+    face->font = font;
+    face->height = TTF_FontHeight(font);
+    return face;
+}
+
+static void free_font_face(FontFace *face) {
+    TTF_CloseFont(face->font);
+    free(face->glyphs);
+    free(face->atlas);
+    free(face);
+}
+
+FontFace *get_font_face(int size) {
+    for (FontFace *face = faces; face; face = face->next) {
+        if (face->size == size)
+            return face;
+    }
+
+    FontFace *face = create_font_face(size);
+    if (!face)
+        return NULL;
+    face->next = faces;
+    faces = face;
+    return face;
+}
+
+// Reserves a w-pixel slot on the current shelf, starting a new shelf or
+// growing the atlas downwards when it is full.
+static bool allocate_atlas_slot(FontFace *face, int w, int *x, int *y) {
+    if (w > GLYPH_ATLAS_WIDTH)
+        return false;
+
+    if (face->shelf_x + w > GLYPH_ATLAS_WIDTH) {
+        face->shelf_x = 0;
+        face->shelf_y += face->height;
+    }
+
+    if (face->shelf_y + face->height > face->atlas_height) {
+        int new_height = face->atlas_height ? face->atlas_height * 2 : face->height * 4;
+        while (face->shelf_y + face->height > new_height)
+            new_height *= 2;
+
+        Uint8 *atlas = realloc(face->atlas, (size_t)GLYPH_ATLAS_WIDTH * new_height);
+        if (!atlas)
+            return false;
+        memset(atlas + (size_t)GLYPH_ATLAS_WIDTH * face->atlas_height, 0,
+               (size_t)GLYPH_ATLAS_WIDTH * (new_height - face->atlas_height));
+        face->atlas = atlas;
+        face->atlas_height = new_height;
+    }
+
+    *x = face->shelf_x;
+    *y = face->shelf_y;
+    face->shelf_x += w;
+    return true;
+}
+
+// Rasterizes a glyph with SDL_ttf and keeps only its coverage.
+static bool rasterize_glyph(FontFace *face, Uint16 codepoint, Glyph *glyph) {
+    int minx, advance;
+    if (TTF_GlyphMetrics(face->font, codepoint, &minx, NULL, NULL, NULL, &advance) != 0)
+        return false;
+
+    *glyph = (Glyph){
+        .codepoint = codepoint,
+        .offset_x = minx < 0 ? minx : 0,
+        .advance = advance,
+    };
+
+    SDL_Surface *surface = TTF_RenderGlyph_Blended(face->font, codepoint, (SDL_Color){255, 255, 255, 255});
+    if (!surface)
+        return true;    // Nothing to draw (e.g. a space), but the advance is valid
+
+    SDL_Surface *argb = surface;
+    if (surface->format->format != SDL_PIXELFORMAT_ARGB8888)
+        argb = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+
+    int w = argb ? argb->w : 0;
+    int h = argb ? SDL_min(argb->h, face->height) : 0;
+    int x, y;
+    bool ok = true;
+    if (w > 0 && h > 0 && allocate_atlas_slot(face, w, &x, &y)) {
+        SDL_LockSurface(argb);
+        for (int row = 0; row < h; row++) {
+            const Uint32 *src = (const Uint32 *)((const Uint8 *)argb->pixels + (size_t)row * argb->pitch);
+            Uint8 *dst = face->atlas + (size_t)(y + row) * GLYPH_ATLAS_WIDTH + x;
+            for (int col = 0; col < w; col++) {
+                dst[col] = (Uint8)(src[col] >> 24);
+            }
+        }
+        SDL_UnlockSurface(argb);
+
+        glyph->x = x;
+        glyph->y = y;
+        glyph->w = w;
+        glyph->h = h;
+        face->atlas_version++;
+    } else if (w > 0 && h > 0) {
+        log_error("No glyph atlas space for U+%04X at size %d", codepoint, face->size);
+        ok = false;
+    }
+
+    if (argb && argb != surface)
+        SDL_FreeSurface(argb);
+    SDL_FreeSurface(surface);
+    return ok;
+}
+
+const Glyph *get_glyph(FontFace *face, Uint16 codepoint) {
+    if (!face)
+        return NULL;
+
+    if (codepoint < 256) {
+        if (face->latin[codepoint])
+            return &face->glyphs[face->latin[codepoint] - 1];
+    } else {
+        for (int i = 0; i < face->glyph_count; i++) {
+            if (face->glyphs[i].codepoint == codepoint)
+                return &face->glyphs[i];
+        }
+    }
+
+    if (face->glyph_count >= face->glyph_capacity) {
+        int new_capacity = face->glyph_capacity ? face->glyph_capacity * 2 : INITIAL_CAPACITY;
+        Glyph *glyphs = realloc(face->glyphs, new_capacity * sizeof(Glyph));
+        if (!glyphs)
+            return NULL;
+        face->glyphs = glyphs;
+        face->glyph_capacity = new_capacity;
+    }
+
+    Glyph *glyph = &face->glyphs[face->glyph_count];
+    if (!rasterize_glyph(face, codepoint, glyph))
+        return NULL;
+
+    face->glyph_count++;
+    if (codepoint < 256)
+        face->latin[codepoint] = face->glyph_count;
+    return glyph;
+}
+
+Uint16 next_codepoint(const char **text) {
+    const Uint8 *s = (const Uint8 *)*text;
+    if (*s == 0)
+        return 0;
+
+    Uint32 codepoint;
+    int length;
+    if (s[0] < 0x80) {
+        codepoint = s[0];
+        length = 1;
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        codepoint = s[0] & 0x1F;
+        length = 2;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        codepoint = s[0] & 0x0F;
+        length = 3;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        codepoint = s[0] & 0x07;
+        length = 4;
+    } else {
+        *text += 1;
+        return '?';
+    }
+
+    for (int i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *text += i;
+            return '?';
+        }
+        codepoint = (codepoint << 6) | (s[i] & 0x3F);
+    }
+    *text += length;
+    return codepoint > 0xFFFF ? '?' : (Uint16)codepoint;
+}
+
+int glyph_kerning(FontFace *face, Uint16 previous, Uint16 current) {
+    if (!face || previous == 0)
+        return 0;
+    return TTF_GetFontKerningSizeGlyphs(face->font, previous, current);
+}
+
+void measure_text(FontFace *face, const char *text, int *w, int *h) {
+    int width = 0;
+    Uint16 previous = 0;
+    Uint16 codepoint;
+
+    while (face && text && (codepoint = next_codepoint(&text)) != 0) {
+        const Glyph *glyph = get_glyph(face, codepoint);
+        if (!glyph)
+            continue;
+        width += glyph_kerning(face, previous, codepoint) + glyph->advance;
+        previous = codepoint;
+    }
+
+    if (w)
+        *w = width;
+    if (h)
+        *h = face ? face->height : 0;
+}
+
+void free_font_cache(void) {
+    while (faces) {
+        FontFace *next = faces->next;
+        free_font_face(faces);
+        faces = next;
+    }
+}
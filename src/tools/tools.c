@@ -1,17 +1,13 @@
 #include "tools/tools.h"
 #include "context/paint_context.h"
 #include "context/logs.h"
+#include "context/profile.h"
 #include <SDL2/SDL_ttf.h>
+#include <float.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define _USE_MATH_DEFINES
-#include <math.h>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846f
-#define M_PI_2 1.57079632679489661923f
-#endif
-
 ToolType get_tooltype_from_string(const char *tool_name) {
     if (strcasecmp(tool_name, "BRUSH") == 0) {
         return TOOL_BRUSH;
@@ -62,298 +58,496 @@ void set_tool_type(Tool *tool, ToolType type) {
     }
 }
 
-void draw_thick_line(SDL_Renderer *renderer, int x1, int y1, int x2, int y2, int size) {
-    const float dx = x2 - x1;
-    const float dy = y2 - y1;
-    const float distance = SDL_sqrtf(dx * dx + dy * dy);
+// Extends [*lo, *hi] to cover the chord of a disc on row y
+static void cover_disc_row(float cx, float cy, float r, float y, float *lo, float *hi) {
+    float h = r * r - (y - cy) * (y - cy);
+    if (h < 0)
+        return;
+    float w = SDL_sqrtf(h);
+    *lo = SDL_min(*lo, cx - w);
+    *hi = SDL_max(*hi, cx + w);
+}
+
+// The brush swept along one segment: a disc moved from a to b
+typedef struct Capsule {
+    float ax, ay, bx, by;   // End points, already offset for even sizes
+    float r;                // Brush radius
+    float dx, dy;           // b - a
+    float len2, len;        // Squared and plain segment length
+    int top, bottom;        // Rows the capsule can touch (unclipped)
+} Capsule;
+
+static void init_capsule(Capsule *c, int x1, int y1, int x2, int y2, int size) {
+    if (size < 1)
+        size = 1;
+
+    // Even sizes center the disc between pixels so it stays `size` pixels wide.
+    const float offset = size % 2 == 0 ? 0.5f : 0.0f;
+    c->ax = x1 - offset;
+    c->ay = y1 - offset;
+    c->bx = x2 - offset;
+    c->by = y2 - offset;
+    c->r = size / 2.0f;
+    c->dx = c->bx - c->ax;
+    c->dy = c->by - c->ay;
+    c->len2 = c->dx * c->dx + c->dy * c->dy;
+    c->len = SDL_sqrtf(c->len2);
+    c->top = (int)SDL_ceilf(SDL_min(c->ay, c->by) - c->r);
+    c->bottom = (int)SDL_floorf(SDL_max(c->ay, c->by) + c->r);
+}
+
+// Pixel span [*x1, *x2] a capsule covers on row y. The capsule is convex, so
+// this is the union of the row's chords through both end discs and the band
+// between them. Returns false if the row misses it.
+static bool capsule_row(const Capsule *c, int y, int *x1, int *x2) {
+    float lo = FLT_MAX;
+    float hi = -FLT_MAX;
+
+    cover_disc_row(c->ax, c->ay, c->r, (float)y, &lo, &hi);
+    cover_disc_row(c->bx, c->by, c->r, (float)y, &lo, &hi);
+
+    if (c->len2 > 0) {
+        const float ry = y - c->ay;
+        float band_lo, band_hi;
+        if (c->dy != 0) {
+            // Points within r of the segment's line...
+            const float base = c->ax + ry * c->dx / c->dy;
+            const float half = c->r * c->len / SDL_fabsf(c->dy);
+            band_lo = base - half;
+            band_hi = base + half;
+            // ...that project onto the segment itself
+            if (c->dx != 0) {
+                float t0 = c->ax - ry * c->dy / c->dx;
+                float t1 = c->ax + (c->len2 - ry * c->dy) / c->dx;
+                band_lo = SDL_max(band_lo, SDL_min(t0, t1));
+                band_hi = SDL_min(band_hi, SDL_max(t0, t1));
+            } else if (ry * c->dy < 0 || ry * c->dy > c->len2) {
+                band_hi = band_lo - 1;
+            }
+        } else if (SDL_fabsf(ry) <= c->r) {
+            band_lo = SDL_min(c->ax, c->bx);
+            band_hi = SDL_max(c->ax, c->bx);
+        } else {
+            band_lo = 0;
+            band_hi = -1;
+        }
+        if (band_lo <= band_hi) {
+            lo = SDL_min(lo, band_lo);
+            hi = SDL_max(hi, band_hi);
+        }
+    }
+
+    if (lo > hi)
+        return false;
+    *x1 = (int)SDL_ceilf(lo);
+    *x2 = (int)SDL_floorf(hi);
+    return *x1 <= *x2;
+}
 
-    if (distance == 0) 
+void draw_thick_line(Canvas *canvas, int x1, int y1, int x2, int y2, int size, Uint32 color) {
+    if (!canvas)
         return;
 
-    const float step_x = dx / distance;
-    const float step_y = dy / distance;
+    Capsule capsule;
+    init_capsule(&capsule, x1, y1, x2, y2, size);
 
-    for (float i = 0; i <= distance; i += 1.0f) {
-        int px = (int)(x1 + step_x * i);
-        int py = (int)(y1 + step_y * i);
+    int top = SDL_max(capsule.top, canvas->clip.y);
+    int bottom = SDL_min(capsule.bottom, canvas->clip.y + canvas->clip.h - 1);
+    for (int y = top; y <= bottom; y++) {
+        int lo, hi;
+        if (capsule_row(&capsule, y, &lo, &hi))
+            canvas_fill_span(canvas, lo, hi, y, color);
+    }
+}
+
+static int compare_capsule_top(const void *a, const void *b) {
+    const Capsule *ca = a, *cb = b;
+    return (ca->top > cb->top) - (ca->top < cb->top);
+}
 
-        SDL_Rect brush = {
-            px - size / 2,
-            py - size / 2,
-            size,
-            size
-        };
-        SDL_RenderFillRect(renderer, &brush);
+static int compare_span_x(const void *a, const void *b) {
+    const Span *sa = a, *sb = b;
+    return (sa->x1 > sb->x1) - (sa->x1 < sb->x1);
+}
+
+// Fills the union of the capsules row by row. Only capsules that reach the
+// current row are visited, and their spans are merged before filling, so
+// joints and self-overlaps are covered once and translucent colors do not
+// build up at the seams. Needs `count` ints and Spans of scratch space.
+static void fill_capsules(Canvas *canvas, Capsule *capsules, int count, int *active, Span *spans, Uint32 color) {
+    int top = INT_MAX, bottom = INT_MIN;
+    for (int i = 0; i < count; i++) {
+        top = SDL_min(top, capsules[i].top);
+        bottom = SDL_max(bottom, capsules[i].bottom);
+    }
+    qsort(capsules, count, sizeof(Capsule), compare_capsule_top);
+    top = SDL_max(top, canvas->clip.y);
+    bottom = SDL_min(bottom, canvas->clip.y + canvas->clip.h - 1);
+
+    int next = 0, active_count = 0;
+    for (int y = top; y <= bottom; y++) {
+        while (next < count && capsules[next].top <= y)
+            active[active_count++] = next++;
+
+        int span_count = 0, kept = 0;
+        for (int i = 0; i < active_count; i++) {
+            const Capsule *c = &capsules[active[i]];
+            if (c->bottom < y)
+                continue;
+            active[kept++] = active[i];
+
+            int x1, x2;
+            if (capsule_row(c, y, &x1, &x2))
+                spans[span_count++] = (Span){x1, x2, y};
+        }
+        active_count = kept;
+        if (span_count == 0)
+            continue;
+
+        qsort(spans, span_count, sizeof(Span), compare_span_x);
+        Span run = spans[0];
+        for (int i = 1; i < span_count; i++) {
+            if (spans[i].x1 <= run.x2 + 1) {
+                run.x2 = SDL_max(run.x2, spans[i].x2);
+            } else {
+                canvas_fill_span(canvas, run.x1, run.x2, y, color);
+                run = spans[i];
+            }
+        }
+        canvas_fill_span(canvas, run.x1, run.x2, y, color);
     }
 }
 
-void draw_thick_circle(SDL_Renderer *renderer, int x1, int y1, int x2, int y2, int size) {
-    const float dx = x2 - x1;
-    const float dy = y2 - y1;
-    const float distance = SDL_sqrtf(dx * dx + dy * dy);
-    
-    if (distance == 0)
+// Capsules of a path with `count` vertices plus the sweep's scratch space
+typedef struct CapsulePath {
+    Capsule *capsules;
+    int *active;
+    Span *spans;
+    int count;
+} CapsulePath;
+
+static bool alloc_capsule_path(CapsulePath *path, int vertices) {
+    // A single vertex is a zero-length segment, i.e. one dab.
+    path->count = vertices > 1 ? vertices - 1 : 1;
+    path->capsules = malloc(path->count * sizeof(Capsule));
+    path->active = malloc(path->count * sizeof(int));
+    path->spans = malloc(path->count * sizeof(Span));
+    return path->capsules && path->active && path->spans;
+}
+
+static void free_capsule_path(CapsulePath *path) {
+    free(path->capsules);
+    free(path->active);
+    free(path->spans);
+}
+
+void draw_thick_polyline(Canvas *canvas, const Point *points, int count, int size, Uint32 color) {
+    if (!canvas || !points || count <= 0)
+        return;
+
+    CapsulePath path;
+    if (!alloc_capsule_path(&path, count)) {
+        // Without scratch space, fall back to separate (overlapping) segments.
+        draw_thick_line(canvas, points[0].x, points[0].y, points[0].x, points[0].y, size, color);
+        for (int i = 1; i < count; i++) {
+            draw_thick_line(canvas, points[i - 1].x, points[i - 1].y, points[i].x, points[i].y, size, color);
+        }
+        free_capsule_path(&path);
         return;
-    
-    const float cx = (x2 + x1) / 2.0f;
-    const float cy = (y2 + y1) / 2.0f;
-    const float radius = distance / 2.0f;
-    
-    const int segments = (int)(2.0f * M_PI * M_PI * radius);
-    const float step = 2.0f * M_PI / segments;
-    
-    float *cos_table = malloc(segments * sizeof(float));
-    float *sin_table = malloc(segments * sizeof(float));
-    
-    for (int i = 0; i < segments; i++) {
-        float theta = i * step;
-        cos_table[i] = SDL_cosf(theta);
-        sin_table[i] = SDL_sinf(theta);
     }
-    
-    for (int r = 0; r < size; r++) {
-        float current_radius = radius - size / 2.0f + r;
-        
-        for (int i = 0; i < segments; i++) {
-            int x = (int)(cx + current_radius * cos_table[i]);
-            int y = (int)(cy + current_radius * sin_table[i]);
-            SDL_RenderDrawPoint(renderer, x, y);
+
+    init_capsule(&path.capsules[0], points[0].x, points[0].y, points[0].x, points[0].y, size);
+    for (int i = 1; i < count; i++) {
+        init_capsule(&path.capsules[i - 1], points[i - 1].x, points[i - 1].y, points[i].x, points[i].y, size);
+    }
+    fill_capsules(canvas, path.capsules, path.count, path.active, path.spans, color);
+    free_capsule_path(&path);
+}
+
+void draw_encoded_polyline(Canvas *canvas, const PointStream *stream, int size, Uint32 color) {
+    if (!canvas || !stream || stream->count <= 0)
+        return;
+
+    PointReader reader;
+    Point last, curr;
+    init_point_reader(&reader, stream);
+    if (!read_point(&reader, &last))
+        return;
+
+    CapsulePath path;
+    if (!alloc_capsule_path(&path, stream->count)) {
+        free_capsule_path(&path);
+        draw_thick_line(canvas, last.x, last.y, last.x, last.y, size, color);
+        while (read_point(&reader, &curr)) {
+            draw_thick_line(canvas, last.x, last.y, curr.x, curr.y, size, color);
+            last = curr;
         }
+        return;
     }
-    
-    free(cos_table);
-    free(sin_table);
+
+    // Vertices are decoded straight into segments; no point array is built.
+    init_capsule(&path.capsules[0], last.x, last.y, last.x, last.y, size);
+    int segments = 0;
+    while (segments < path.count && read_point(&reader, &curr)) {
+        init_capsule(&path.capsules[segments++], last.x, last.y, curr.x, curr.y, size);
+        last = curr;
+    }
+    fill_capsules(canvas, path.capsules, SDL_max(segments, 1), path.active, path.spans, color);
+    free_capsule_path(&path);
 }
 
-bool colors_equal(SDL_Color *a, SDL_Color *b) {
-    return a->a == b->a && a->r == b->r && a->g == b->g && a->b == b->b;
-}   
+// Floor and ceiling of a / 2 for possibly negative a
+static inline int half_floor(int a) {
+    return a >= 0 ? a / 2 : -((1 - a) / 2);
+}
 
-static SDL_Color get_pixel(SDL_Surface* surface, int x, int y) {
-    Uint32 *pixels = (Uint32 *)surface->pixels;
-    Uint32 pixel = pixels[(y * surface->w) + x];
-    SDL_Color color;
-    SDL_GetRGBA(pixel, surface->format, &color.r, &color.g, &color.b, &color.a);
-    return color;
+static inline int half_ceil(int a) {
+    return -half_floor(-a);
 }
 
-static void set_pixel(SDL_Surface* surface, int x, int y, SDL_Color color) {
-    Uint32 pixel = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
-    Uint32 *pixels = (Uint32 *)surface->pixels;
-    pixels[(y * surface->w) + x] = pixel;
+// Fills row y of the annulus: columns whose doubled offset from the center
+// lies within `outer`, minus those within `inner` (-1 for no hole).
+static void fill_annulus_row(Canvas *canvas, int sx, int y, int outer, int inner, Uint32 color) {
+    int x1 = half_ceil(sx - outer);
+    int x2 = half_floor(sx + outer);
+
+    if (inner < 0) {
+        canvas_fill_span(canvas, x1, x2, y, color);
+        return;
+    }
+
+    int hole1 = half_ceil(sx - inner);
+    int hole2 = half_floor(sx + inner);
+    if (hole1 > hole2) {
+        canvas_fill_span(canvas, x1, x2, y, color);
+        return;
+    }
+    if (hole1 > x1)
+        canvas_fill_span(canvas, x1, hole1 - 1, y, color);
+    if (hole2 < x2)
+        canvas_fill_span(canvas, hole2 + 1, x2, y, color);
 }
 
-int flood_fill(SDL_Renderer *renderer, int start_x, int start_y, 
-               SDL_Color target_color, SDL_Color fill_color, Point** out_points) {
-    int width, height;
-    SDL_GetRendererOutputSize(renderer, &width, &height);
-    
-    if (start_x < 0 || start_y < 0 || start_x >= width || start_y >= height) {
-        return -1;
+void draw_thick_circle(Canvas *canvas, int x1, int y1, int x2, int y2, int size, Uint32 color) {
+    if (!canvas || (x1 == x2 && y1 == y2))
+        return;
+
+    // Work in doubled coordinates so the center, which sits halfway between
+    // the two points, and the radii stay integral.
+    const long dx = x2 - x1;
+    const long dy = y2 - y1;
+    const int diameter = (int)(SDL_sqrt((double)(dx * dx + dy * dy)) + 0.5);
+    const int sx = x1 + x2;
+    const int sy = y1 + y2;
+    const long ro = diameter + (size > 0 ? size : 1);
+    const long ri = diameter - size;
+
+    // Walk rows from the top edge towards the center; the half-widths only
+    // grow on the way, so each is advanced incrementally (midpoint style)
+    // and the bottom half is mirrored around the center row.
+    int outer = 0;
+    int inner = -1;
+    for (int y = half_ceil(sy - (int)ro); 2 * y <= sy; y++) {
+        const long oy = 2L * y - sy;
+        const long oy2 = oy * oy;
+
+        while ((long)(outer + 1) * (outer + 1) + oy2 <= ro * ro)
+            outer++;
+        if (ri > 0) {
+            while ((long)(inner + 1) * (inner + 1) + oy2 < ri * ri)
+                inner++;
+        }
+
+        fill_annulus_row(canvas, sx, y, outer, inner, color);
+        if (sy - y != y)
+            fill_annulus_row(canvas, sx, sy - y, outer, inner, color);
     }
-    
-    if (colors_equal(&target_color, &fill_color)) {
-        return -1;
+}
+
+// Growable array used by flood_fill for both its seed stack and its output
+typedef struct {
+    Span *items;
+    int count;
+    int capacity;
+} SpanList;
+
+static bool push_span(SpanList *list, int x1, int x2, int y) {
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 64;
+        Span *items = realloc(list->items, new_capacity * sizeof(Span));
+        if (!items)
+            return false;
+        list->items = items;
+        list->capacity = new_capacity;
     }
-    
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-    if (!surface) {
-        log_error("Failed to create surface for flood fill");
-        return -1;
+    list->items[list->count++] = (Span){x1, x2, y};
+    return true;
+}
+
+// Pushes one seed for every run of `target` pixels on `row` within [x1, x2].
+static bool push_seeds(SpanList *seeds, const Uint32 *row, int x1, int x2, int y, Uint32 target) {
+    int x = x1;
+    while (x <= x2) {
+        while (x <= x2 && row[x] != target)
+            x++;
+        if (x > x2)
+            break;
+        if (!push_span(seeds, x, x, y))
+            return false;
+        while (x <= x2 && row[x] == target)
+            x++;
     }
+    return true;
+}
+
+int flood_fill(Canvas *canvas, int start_x, int start_y, 
+               SDL_Color fill_color, Span** out_spans) {
+    const int width = canvas->width;
+    const int height = canvas->height;
     
-    SDL_Texture *prev_target = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, NULL);
-    
-    if (SDL_RenderReadPixels(renderer, NULL, surface->format->format,
-                           surface->pixels, surface->pitch) != 0) {
-        log_error("Failed to read pixels: %s", SDL_GetError());
-        SDL_FreeSurface(surface);
+    if (start_x < 0 || start_y < 0 || start_x >= width || start_y >= height) {
         return -1;
     }
     
-    SDL_Color start_pixel = get_pixel(surface, start_x, start_y);
-    if (!colors_equal(&target_color, &start_pixel)) {
-        SDL_FreeSurface(surface);
+    const Uint32 target = canvas_get_pixel(canvas, start_x, start_y);
+    const Uint32 fill = canvas_map_color(fill_color);
+    if (target == fill) {
         return 0;
     }
     
-    Point* stack = malloc(sizeof(Point) * width * height);
-    if (!stack) {
-        SDL_FreeSurface(surface);
-        return -1;
-    }
-    
-    Point* filled_points = malloc(sizeof(Point) * width * height);
-    if (!filled_points) {
-        free(stack);
-        SDL_FreeSurface(surface);
+    // Single readback; filled pixels are overwritten with `fill` in this
+    // copy, which also marks them as visited.
+    SDL_Rect bounds = {0, 0, width, height};
+    Uint32 *pixels = malloc(sizeof(Uint32) * width * height);
+    if (!pixels) {
         return -1;
     }
+    canvas_read_pixels(canvas, &bounds, pixels, width);
     
-    int stack_top = 0;
-    int filled_count = 0;
+    SpanList seeds = {0};
+    SpanList filled = {0};
+    bool ok = push_span(&seeds, start_x, start_x, start_y);
     
-    stack[stack_top++] = (Point){start_x, start_y};
-    
-    int dx[] = {-1, 1, 0, 0};
-    int dy[] = {0, 0, -1, 1};
-    
-    while (stack_top > 0) {
-        Point current = stack[--stack_top];
-        int x = current.x;
-        int y = current.y;
-        
-        if (x < 0 || x >= width || y < 0 || y >= height) {
-            continue;
-        }
-        
-        SDL_Color pixel = get_pixel(surface, x, y);
-        if (!colors_equal(&target_color, &pixel)) {
+    while (ok && seeds.count > 0) {
+        Span seed = seeds.items[--seeds.count];
+        Uint32 *row = &pixels[(size_t)seed.y * width];
+        if (row[seed.x1] != target) {
             continue;
         }
         
-        set_pixel(surface, x, y, fill_color);
-        filled_points[filled_count++] = (Point){x, y};
+        int left = seed.x1;
+        int right = seed.x1;
+        while (left > 0 && row[left - 1] == target)
+            left--;
+        while (right < width - 1 && row[right + 1] == target)
+            right++;
         
-        for (int i = 0; i < 4; i++) {
-            int nx = x + dx[i];
-            int ny = y + dy[i];
-            
-            if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                SDL_Color next_pixel = get_pixel(surface, nx, ny);
-                if (colors_equal(&target_color, &next_pixel)) {
-                    stack[stack_top++] = (Point){nx, ny};
-                }
-            }
+        for (int x = left; x <= right; x++) {
+            row[x] = fill;
         }
-    }
-
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    if (texture) {
-        SDL_SetRenderTarget(renderer, prev_target);
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_DestroyTexture(texture);
+        ok = push_span(&filled, left, right, seed.y);
+        
+        if (ok && seed.y > 0)
+            ok = push_seeds(&seeds, row - width, left, right, seed.y - 1, target);
+        if (ok && seed.y < height - 1)
+            ok = push_seeds(&seeds, row + width, left, right, seed.y + 1, target);
     }
     
-    free(stack);
-    SDL_FreeSurface(surface);
+    free(seeds.items);
+    free(pixels);
     
-    if (out_points) {
-        *out_points = filled_points;
-    } else {
-        free(filled_points);
+    if (!ok) {
+        free(filled.items);
+        return -1;
     }
     
-    return filled_count;
-}
-
-static SDL_Color get_pixel_with_renderer(SDL_Renderer *renderer, int x, int y) {
-    int width, height;
-    SDL_GetRendererOutputSize(renderer, &width, &height);
-
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, 32,
-        0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-
-    SDL_Color default_color = {0, 0, 0, 0};
-    
-    if (!surface) {
-        log_error("Failed to create surface for getting target color");
-        return default_color;
+    for (int i = 0; i < filled.count; i++) {
+        canvas_fill_span(canvas, filled.items[i].x1, filled.items[i].x2, filled.items[i].y, fill);
     }
     
-    if (SDL_RenderReadPixels(renderer, NULL, surface->format->format,
-                        surface->pixels, surface->pitch) != 0) {
-        log_error("Failed to read pixels: %s", SDL_GetError());
-        SDL_FreeSurface(surface);
-        return default_color;
+    if (out_spans) {
+        *out_spans = filled.items;
+    } else {
+        free(filled.items);
     }
     
-    SDL_Color target_color = get_pixel(surface, x, y);
-    SDL_FreeSurface(surface);
-    
-    return target_color; 
+    return filled.count;
 }
 
-void render_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color color) {
-    if (!font || !text || strlen(text) == 0) {
-        return;
-    }
-    
-    SDL_Surface *text_surface = TTF_RenderText_Blended(font, text, color);
-    if (!text_surface) {
-        log_error("Failed to create text surface: %s", TTF_GetError());
+void render_text(Canvas *canvas, FontFace *face, const char *text, int x, int y, SDL_Color color) {
+    if (!canvas || !face || !text) {
         return;
     }
-    
-    SDL_Texture *text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-    if (!text_texture) {
-        log_error("Failed to create text texture: %s", SDL_GetError());
-        SDL_FreeSurface(text_surface);
-        return;
+
+    const Uint32 pixel = canvas_map_color(color);
+    int pen_x = x;
+    Uint16 previous = 0;
+    Uint16 codepoint;
+
+    while ((codepoint = next_codepoint(&text)) != 0) {
+        const Glyph *glyph = get_glyph(face, codepoint);
+        if (!glyph)
+            continue;
+
+        pen_x += glyph_kerning(face, previous, codepoint);
+        if (glyph->w > 0) {
+            SDL_Rect rect = {pen_x + glyph->offset_x, y, glyph->w, glyph->h};
+            const Uint8 *mask = face->atlas + (size_t)glyph->y * GLYPH_ATLAS_WIDTH + glyph->x;
+            canvas_blend_mask(canvas, mask, GLYPH_ATLAS_WIDTH, &rect, pixel);
+        }
+        pen_x += glyph->advance;
+        previous = codepoint;
     }
-    
-    SDL_Rect text_rect = {
-        x,
-        y,
-        text_surface->w,
-        text_surface->h
-    };
-    
-    SDL_RenderCopy(renderer, text_texture, NULL, &text_rect);
-    
-    SDL_DestroyTexture(text_texture);
-    SDL_FreeSurface(text_surface);
 }
 
 void use_tool(PaintContext* context, int prev_x, int prev_y) {
+    PROFILE_SCOPE("use_tool");
     Tool *tool = &context->current_tool; 
-    SDL_SetRenderDrawColor(context->renderer, tool->color.r, tool->color.g, tool->color.b, tool->color.a);
+    Canvas *canvas = context->canvas;
+    if (!canvas)
+        return;
+    Uint32 color = canvas_map_color(tool->color);
 
     switch (tool->type) {
     case TOOL_BRUSH:
     case TOOL_ERASER: {
         add_point_to_current_stroke(context, context->mouse_x, context->mouse_y);
         if (prev_x != -1 && prev_y != -1) {
-            draw_thick_line(context->renderer, prev_x, prev_y, context->mouse_x, context->mouse_y, tool->size);
+            draw_thick_line(canvas, prev_x, prev_y, context->mouse_x, context->mouse_y, tool->size, color);
         } else {
-            SDL_Rect brush = {
-                context->mouse_x - tool->size / 2,
-                context->mouse_y - tool->size / 2,
-                tool->size,
-                tool->size
-            };
-            SDL_RenderFillRect(context->renderer, &brush);
+            draw_thick_line(canvas, context->mouse_x, context->mouse_y, context->mouse_x, context->mouse_y, tool->size, color);
         }
         break;
     }
     case TOOL_LINE: {
         add_point_to_current_stroke(context, context->mouse_x, context->mouse_y);
         if (prev_x != -1 && prev_y != -1 && context->mouse_x != -1 && context->mouse_y != -1) {
-            draw_thick_line(context->renderer, prev_x, prev_y, context->mouse_x, context->mouse_y, tool->size);
+            draw_thick_line(canvas, prev_x, prev_y, context->mouse_x, context->mouse_y, tool->size, color);
         }
         break;
     }
     case TOOL_CIRCLE: {
         add_point_to_current_stroke(context, context->mouse_x, context->mouse_y);
         if (prev_x != -1 && prev_y != -1 && context->mouse_x != -1 && context->mouse_y != -1) {
-            draw_thick_circle(context->renderer, prev_x, prev_y, context->mouse_x, context->mouse_y, tool->size);
+            draw_thick_circle(canvas, prev_x, prev_y, context->mouse_x, context->mouse_y, tool->size, color);
         }
         break;
     }
     case TOOL_FILL: {
-        Point* filled_points = NULL;
-        SDL_Color target_color = get_pixel_with_renderer(context->renderer, context->mouse_x, context->mouse_y);
-        SDL_Color fill_color = tool->color;
-        int count = flood_fill(context->renderer, context->mouse_x, context->mouse_y, 
-                            target_color, fill_color, &filled_points);
-
-        if (count > 0 && filled_points) {
-            for (int i = 0; i < count; i++) {
-                add_point_to_current_stroke(context, filled_points[i].x, filled_points[i].y);
+        Span* filled_spans = NULL;
+        int count = flood_fill(canvas, context->mouse_x, context->mouse_y, 
+                            tool->color, &filled_spans);
+
+        if (count > 0 && filled_spans) {
+            // The seed point marks where the fill started; the area itself is stored as spans.
+            // A fill the stroke cannot hold could not be replayed, so it is taken back.
+            Point seed = {context->mouse_x, context->mouse_y};
+            if (!add_points_to_current_stroke(context, &seed, 1) ||
+                !add_spans_to_entry(context->current_stroke, filled_spans, count)) {
+                log_error("Failed to record a %d span fill; the fill was undone", count);
+                cancel_stroke(context);
             }
-            free(filled_points);
+            free(filled_spans);
         } else if (count == -1) {
             log_error("Flood fill failed");
         }
@@ -370,6 +564,27 @@ void use_tool(PaintContext* context, int prev_x, int prev_y) {
     }
 }
 
+void extend_stroke(PaintContext *context, const Point *points, int count) {
+    Tool *tool = &context->current_tool;
+    HistoryEntry *stroke = context->current_stroke;
+    if (!context->canvas || !stroke || count <= 0)
+        return;
+    if (tool->type != TOOL_BRUSH && tool->type != TOOL_ERASER)
+        return;
+    PROFILE_SCOPE("extend_stroke");
+
+    // The path continues from the last sample already in the stroke, which
+    // the append leaves directly in front of the new ones.
+    int joined = stroke->count > 0 ? 1 : 0;
+    if (!add_points_to_current_stroke(context, points, count))
+        return;
+
+    const Point *path = &stroke->points[stroke->count - count - joined];
+    draw_thick_polyline(context->canvas, path, count + joined, tool->size, canvas_map_color(tool->color));
+    context->mouse_x = points[count - 1].x;
+    context->mouse_y = points[count - 1].y;
+}
+
 const char* get_tool_name(const Tool* tool) {
     switch (tool->type) {
     case TOOL_BRUSH:
@@ -384,6 +599,8 @@ const char* get_tool_name(const Tool* tool) {
         return "FILL";
     case TOOL_TEXT:
         return "TEXT";
+    case TOOL_CLEAR:
+        return "CLEAR";
     default:
         return "UNKNOWN";
     }
@@ -0,0 +1,111 @@
+// Build-time asset packer. Decodes each input and writes it out as C source
+// defining the objects declared in include/asset_pack.h: PNGs become
+// AssetImage pixel arrays, anything else an AssetData byte array.
+//
+// usage: pack_assets OUTPUT NAME=FILE...
+
+#define SDL_MAIN_HANDLED
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+static bool has_suffix(const char *text, const char *suffix) {
+    size_t length = strlen(text);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(text + length - suffix_length, suffix) == 0;
+}
+
+// Writes the image as ARGB8888 with straight alpha, the format the UI
+// uploads its icon textures in
+static bool write_image(FILE *out, const char *name, const char *path) {
+    SDL_Surface *loaded = IMG_Load(path);
+    if (!loaded) {
+        fprintf(stderr, "pack_assets: %s: %s\n", path, SDL_GetError());
+        return false;
+    }
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface) {
+        fprintf(stderr, "pack_assets: %s: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    fprintf(out, "static const Uint32 %s_pixels[] = {", name);
+    for (int y = 0; y < surface->h; y++) {
+        const Uint32 *row = (const Uint32 *)(const void *)((const Uint8 *)surface->pixels + y * surface->pitch);
+        for (int x = 0; x < surface->w; x++) {
+            int i = y * surface->w + x;
+            fprintf(out, "%s0x%08x,", i % 8 ? " " : "\n    ", (unsigned)row[x]);
+        }
+    }
+    fprintf(out, "\n};\nconst AssetImage asset_%s = {%d, %d, %s_pixels};\n\n",
+            name, surface->w, surface->h, name);
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+static bool write_data(FILE *out, const char *name, const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+
+    fprintf(out, "static const Uint8 %s_data[] = {", name);
+    unsigned char buffer[4096];
+    size_t total = 0;
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        for (size_t i = 0; i < read; i++, total++)
+            fprintf(out, "%s0x%02x,", total % 16 ? " " : "\n    ", buffer[i]);
+    }
+    bool ok = !ferror(in);
+    fclose(in);
+    if (!ok) {
+        perror(path);
+        return false;
+    }
+    fprintf(out, "\n};\nconst AssetData asset_%s = {%s_data, sizeof(%s_data)};\n\n", name, name, name);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s OUTPUT NAME=FILE...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(out, "// Generated by tools/pack_assets.c; do not edit\n\n#include \"asset_pack.h\"\n\n");
+
+    bool ok = true;
+    for (int i = 2; ok && i < argc; i++) {
+        char name[64];
+        const char *separator = strchr(argv[i], '=');
+        size_t length = separator ? (size_t)(separator - argv[i]) : 0;
+        if (length == 0 || length >= sizeof(name)) {
+            fprintf(stderr, "pack_assets: expected NAME=FILE, got %s\n", argv[i]);
+            ok = false;
+            break;
+        }
+        memcpy(name, argv[i], length);
+        name[length] = '\0';
+
+        const char *path = separator + 1;
+        ok = has_suffix(path, ".png") ? write_image(out, name, path) : write_data(out, name, path);
+    }
+
+    if (fclose(out) != 0)
+        ok = false;
+    if (!ok) {
+        remove(argv[1]);
+        return 1;
+    }
+    return 0;
+}